@@ -5,6 +5,10 @@
 //
 
 //
+// version 0.9.12: Streaming triangle batches (LoadObjStreamed).
+// version 0.9.11: Binary mesh cache (MeshCache, LoadObjCached).
+// version 0.9.10: Memory mapped input, SIMD line scanner and exact fast
+//                 float parser.
 // version 0.9.9: Replace atof() with custom parser.
 // version 0.9.8: Fix multi-materials(per-face material ID).
 // version 0.9.7: Support multi-materials(per-face material ID) per
@@ -21,6 +25,7 @@
 //
 
 #include <cstdlib>
+#include <cstdio>
 #include <cstring>
 #include <cassert>
 #include <cmath>
@@ -30,6 +35,29 @@
 #include <map>
 #include <fstream>
 #include <sstream>
+#include <iterator>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <intrin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TINYOBJ_USE_SSE2
+#include <emmintrin.h>
+#endif
 
 #include "tiny_obj_loader.h"
 
@@ -42,17 +70,104 @@ struct vertex_index {
   vertex_index(int vidx, int vtidx, int vnidx)
       : v_idx(vidx), vt_idx(vtidx), vn_idx(vnidx){};
 };
-// for std::map
-static inline bool operator<(const vertex_index &a, const vertex_index &b) {
-  if (a.v_idx != b.v_idx)
-    return (a.v_idx < b.v_idx);
-  if (a.vn_idx != b.vn_idx)
-    return (a.vn_idx < b.vn_idx);
-  if (a.vt_idx != b.vt_idx)
-    return (a.vt_idx < b.vt_idx);
+// Open addressing hash table for vertex de-duplication.
+// The (v, vt, vn) triple is used as a packed 96-bit key. Slots are tagged with
+// a generation counter, so clear() is O(1) and the table can be reused for
+// every face group without reallocating or copying.
+class vertex_cache {
+public:
+  vertex_cache() : size_(0), mask_(0), generation_(1) {}
+
+  // Make room for at least 'count' keys without rehashing.
+  void reserve(size_t count) {
+    size_t want = 16;
+    while (want < count * 2)
+      want <<= 1;
+    if (want > slots_.size())
+      rehash(want);
+  }
 
-  return false;
-}
+  void clear() {
+    size_ = 0;
+    if (++generation_ == 0) {
+      // generation wrapped around, stale tags could alias the new one.
+      for (size_t i = 0; i < slots_.size(); i++)
+        slots_[i].generation = 0;
+      generation_ = 1;
+    }
+  }
+
+  // Returns the slot value for 'key'. 'inserted' is set when the key was not
+  // present yet, in which case the caller must store the value.
+  unsigned int &find_or_insert(const vertex_index &key, bool &inserted) {
+    if ((size_ + 1) * 2 > slots_.size())
+      rehash(slots_.empty() ? 16 : slots_.size() * 2);
+
+    size_t i = hash(key) & mask_;
+    for (;;) {
+      slot &s = slots_[i];
+      if (s.generation != generation_) {
+        s.generation = generation_;
+        s.key = key;
+        s.value = 0;
+        size_++;
+        inserted = true;
+        return s.value;
+      }
+      if (s.key.v_idx == key.v_idx && s.key.vt_idx == key.vt_idx &&
+          s.key.vn_idx == key.vn_idx) {
+        inserted = false;
+        return s.value;
+      }
+      i = (i + 1) & mask_;
+    }
+  }
+
+private:
+  struct slot {
+    vertex_index key;
+    unsigned int value;
+    unsigned int generation;
+  };
+
+  static inline size_t hash(const vertex_index &k) {
+    // 64-bit mix of the three indices (murmur3 finalizer).
+    unsigned long long h = (unsigned long long)(unsigned int)k.v_idx;
+    h ^= (unsigned long long)(unsigned int)k.vt_idx << 21;
+    h ^= (unsigned long long)(unsigned int)k.vn_idx << 42;
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdULL;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return (size_t)h;
+  }
+
+  void rehash(size_t capacity) {
+    std::vector<slot> old;
+    old.swap(slots_);
+    unsigned int old_generation = generation_;
+
+    slot empty;
+    empty.generation = 0;
+    slots_.assign(capacity, empty);
+    mask_ = capacity - 1;
+    size_ = 0;
+    generation_ = 1;
+
+    for (size_t i = 0; i < old.size(); i++) {
+      if (old[i].generation != old_generation)
+        continue;
+      bool inserted;
+      find_or_insert(old[i].key, inserted) = old[i].value;
+    }
+  }
+
+  std::vector<slot> slots_;
+  size_t size_;
+  size_t mask_;
+  unsigned int generation_;
+};
 
 struct obj_shape {
   std::vector<float> v;
@@ -73,10 +188,169 @@ static inline int fixIndex(int idx, int n) {
   return n + idx; // negative value = relative
 }
 
+// Read-only view of a whole file. The file is memory mapped, so parsing reads
+// straight from the page cache without an intermediate copy.
+class mapped_file {
+public:
+  mapped_file() : data_(NULL), size_(0) {
+#ifdef _WIN32
+    file_ = INVALID_HANDLE_VALUE;
+    mapping_ = NULL;
+#endif
+  }
+  ~mapped_file() { close(); }
+
+  bool open(const char *filename) {
+    close();
+#ifdef _WIN32
+    file_ = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+                        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file_ == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file_, &size)) {
+      close();
+      return false;
+    }
+    size_ = (size_t)size.QuadPart;
+    if (size_ == 0) // empty files can not be mapped, but are valid.
+      return true;
+    mapping_ = CreateFileMappingA(file_, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (mapping_ == NULL) {
+      close();
+      return false;
+    }
+    data_ = (const char *)MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0);
+#else
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      ::close(fd);
+      return false;
+    }
+    size_ = (size_t)st.st_size;
+    if (size_ == 0) {
+      ::close(fd);
+      return true;
+    }
+    void *p = mmap(NULL, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (p != MAP_FAILED) {
+      madvise(p, size_, MADV_SEQUENTIAL);
+      data_ = (const char *)p;
+    }
+#endif
+    if (data_ == NULL) {
+      close();
+      return false;
+    }
+    return true;
+  }
+
+  void close() {
+#ifdef _WIN32
+    if (data_)
+      UnmapViewOfFile(data_);
+    if (mapping_)
+      CloseHandle(mapping_);
+    if (file_ != INVALID_HANDLE_VALUE)
+      CloseHandle(file_);
+    file_ = INVALID_HANDLE_VALUE;
+    mapping_ = NULL;
+#else
+    if (data_)
+      munmap((void *)data_, size_);
+#endif
+    data_ = NULL;
+    size_ = 0;
+  }
+
+  const char *begin() const { return data_; }
+  const char *end() const { return data_ + size_; }
+  size_t size() const { return size_; }
+
+private:
+  mapped_file(const mapped_file &);
+  mapped_file &operator=(const mapped_file &);
+
+  const char *data_;
+  size_t size_;
+#ifdef _WIN32
+  HANDLE file_;
+  HANDLE mapping_;
+#endif
+};
+
+static inline int countTrailingZeros(unsigned int mask) {
+#ifdef _MSC_VER
+  unsigned long i;
+  _BitScanForward(&i, mask);
+  return (int)i;
+#else
+  return __builtin_ctz(mask);
+#endif
+}
+
+// Returns the first '\n' in [p, end), or end. Scans 16 bytes per step.
+// Only line splitting is vectorised. Tokens inside a line are a few bytes
+// long and are scanned with strspn/strcspn.
+static inline const char *findNewLine(const char *p, const char *end) {
+#ifdef TINYOBJ_USE_SSE2
+  const __m128i nl = _mm_set1_epi8('\n');
+  for (; end - p >= 16; p += 16) {
+    __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+    unsigned int mask =
+        (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl));
+    if (mask)
+      return p + countTrailingZeros(mask);
+  }
+#endif
+  const char *nl_pos = (const char *)memchr(p, '\n', end - p);
+  return nl_pos ? nl_pos : end;
+}
+
+// Splits a buffer into lines. Every line returned by next() is followed by a
+// '\n' or '\0' in memory, so the token parsers below stop at the line end
+// without needing to know it. The last line of a buffer that does not end with
+// a newline is copied into a small terminated buffer to keep that guarantee.
+class line_reader {
+public:
+  line_reader(const char *begin, const char *end) : cur_(begin), end_(end) {}
+
+  bool next(const char *&line, const char *&line_end) {
+    if (cur_ >= end_)
+      return false;
+
+    const char *eol = findNewLine(cur_, end_);
+    if (eol == end_) {
+      tail_.assign(cur_, end_);
+      line = tail_.c_str();
+      line_end = line + tail_.size();
+      cur_ = end_;
+    } else {
+      line = cur_;
+      line_end = eol;
+      cur_ = eol + 1;
+    }
+
+    // Trim '\r' of "\r\n" line endings.
+    if (line_end > line && line_end[-1] == '\r')
+      line_end--;
+    return true;
+  }
+
+private:
+  const char *cur_;
+  const char *end_;
+  std::string tail_;
+};
+
 static inline std::string parseString(const char *&token) {
   std::string s;
   token += strspn(token, " \t");
-  int e = strcspn(token, " \t\r");
+  int e = strcspn(token, " \t\r\n");
   s = std::string(token, &token[e]);
   token += e;
   return s;
@@ -85,168 +359,112 @@ static inline std::string parseString(const char *&token) {
 static inline int parseInt(const char *&token) {
   token += strspn(token, " \t");
   int i = atoi(token);
-  token += strcspn(token, " \t\r");
+  token += strcspn(token, " \t\r\n");
   return i;
 }
 
+static inline bool isDigit(const char c) { return (unsigned)(c - '0') < 10; }
 
-// Tries to parse a floating point number located at s.
-//
-// s_end should be a location in the string where reading should absolutely
-// stop. For example at the end of the string, to prevent buffer overflows.
-//
-// Parses the following EBNF grammar:
-//   sign    = "+" | "-" ;
-//   END     = ? anything not in digit ?
-//   digit   = "0" | "1" | "2" | "3" | "4" | "5" | "6" | "7" | "8" | "9" ;
-//   integer = [sign] , digit , {digit} ;
-//   decimal = integer , ["." , integer] ;
-//   float   = ( decimal , END ) | ( decimal , ("E" | "e") , integer , END ) ;
-//
-//  Valid strings are for example:
-//   -0	 +3.1417e+2  -0.0E-3  1.0324  -1.41   11e2
+// Parses a floating point number at token, and moves token past it.
 //
-// If the parsing is a success, result is set to the parsed value and true 
-// is returned.
-//
-// The function is greedy and will parse until any of the following happens:
-//  - a non-conforming character is encountered.
-//  - s_end is reached.
-//
-// The following situations triggers a failure:
-//  - s >= s_end.
-//  - parse failure.
-// 
-static bool tryParseDouble(const char *s, const char *s_end, double *result)
-{
-	if (s >= s_end)
-	{
-		return false;
-	}
-
-	double mantissa = 0.0;
-	// This exponent is base 2 rather than 10.
-	// However the exponent we parse is supposed to be one of ten,
-	// thus we must take care to convert the exponent/and or the 
-	// mantissa to a * 2^E, where a is the mantissa and E is the
-	// exponent.
-	// To get the final double we will use ldexp, it requires the
-	// exponent to be in base 2.
-	int exponent = 0;
-
-	// NOTE: THESE MUST BE DECLARED HERE SINCE WE ARE NOT ALLOWED
-	// TO JUMP OVER DEFINITIONS.
-	char sign = '+';
-	char exp_sign = '+';
-	char const *curr = s;
-
-	// How many characters were read in a loop. 
-	int read = 0;
-	// Tells whether a loop terminated due to reaching s_end.
-	bool end_not_reached = false;
-
-	/*
-		BEGIN PARSING.
-	*/
-
-	// Find out what sign we've got.
-	if (*curr == '+' || *curr == '-')
-	{
-		sign = *curr;
-		curr++;
-	}
-	else if (isdigit(*curr)) { /* Pass through. */ }
-	else
-	{
-		goto fail;
-	}
-
-	// Read the integer part.
-	while ((end_not_reached = (curr != s_end)) && isdigit(*curr))
-	{
-		mantissa *= 10;
-		mantissa += static_cast<int>(*curr - 0x30);
-		curr++;	read++;
-	}
-
-	// We must make sure we actually got something.
-	if (read == 0)
-		goto fail;
-	// We allow numbers of form "#", "###" etc.
-	if (!end_not_reached)
-		goto assemble;
-
-	// Read the decimal part.
-	if (*curr == '.')
-	{
-		curr++;
-		read = 1;
-		while ((end_not_reached = (curr != s_end)) && isdigit(*curr))
-		{
-			// NOTE: Don't use powf here, it will absolutely murder precision.
-			mantissa += static_cast<int>(*curr - 0x30) * pow(10, -read);
-			read++; curr++;
-		}
-	}
-	else if (*curr == 'e' || *curr == 'E') {}
-	else
-	{
-		goto assemble;
-	}
-
-	if (!end_not_reached)
-		goto assemble;
-
-	// Read the exponent part.
-	if (*curr == 'e' || *curr == 'E')
-	{
-		curr++;
-		// Figure out if a sign is present and if it is.
-		if ((end_not_reached = (curr != s_end)) && (*curr == '+' || *curr == '-'))
-		{
-			exp_sign = *curr;
-			curr++;
-		}
-		else if (isdigit(*curr)) { /* Pass through. */ }
-		else
-		{
-			// Empty E is not allowed.
-			goto fail;
-		}
-
-		read = 0;
-		while ((end_not_reached = (curr != s_end)) && isdigit(*curr))
-		{
-			exponent *= 10;
-			exponent += static_cast<int>(*curr - 0x30);
-			curr++;	read++;
-		}
-		exponent *= (exp_sign == '+'? 1 : -1);
-		if (read == 0)
-			goto fail;
-	}
-
-assemble:
-	*result = (sign == '+'? 1 : -1) * ldexp(mantissa * pow(5, exponent), exponent);
-	return true;
-fail:
-	return false;
-}
-static inline float parseFloat(const char *&token) {
+// Up to 19 significant decimal digits are accumulated into an integer
+// mantissa, plus a decimal exponent. When both are small enough the value is
+// computed with a single correctly rounded float (or double) operation, which
+// is exact (Clinger's fast path) and gives the same result as
+// (float)strtod(). Everything else, e.g. very long mantissas or huge
+// exponents, falls back to strtod() on a stack copy of the token. Nothing is
+// allocated either way.
+static float parseFloat(const char *&token) {
+  static const float pow10f[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                 1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+  static const double pow10d[] = {1e0,  1e1,  1e2,  1e3,  1e4,  1e5,
+                                  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+                                  1e12, 1e13, 1e14, 1e15, 1e16, 1e17,
+                                  1e18, 1e19, 1e20, 1e21, 1e22};
+
   token += strspn(token, " \t");
-#ifdef TINY_OBJ_LOADER_OLD_FLOAT_PARSER
-  float f = (float)atof(token);
-  token += strcspn(token, " \t\r");
-#else
-  const char *end = token + strcspn(token, " \t\r");
-  double val = 0.0;
-  tryParseDouble(token, end, &val);
-  float f = static_cast<float>(val);
-  token = end;
-#endif
-  return f;
-}
+  const char *start = token;
+  const char *p = token;
+
+  bool negative = false;
+  if (*p == '+' || *p == '-') {
+    negative = (*p == '-');
+    p++;
+  }
+
+  unsigned long long mantissa = 0;
+  int digits = 0;      // significant digits in mantissa
+  int exponent = 0;    // decimal exponent applied to mantissa
+  bool any = false;    // at least one digit seen
+  bool exact = true;   // no significant digit was dropped
+
+  for (; isDigit(*p); p++) {
+    any = true;
+    if (digits < 19) {
+      mantissa = mantissa * 10 + (*p - '0');
+      if (mantissa)
+        digits++;
+    } else {
+      exponent++;
+      exact = exact && (*p == '0');
+    }
+  }
+  if (*p == '.') {
+    p++;
+    for (; isDigit(*p); p++) {
+      any = true;
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        if (mantissa)
+          digits++;
+        exponent--;
+      } else {
+        exact = exact && (*p == '0');
+      }
+    }
+  }
+  if (any && (*p == 'e' || *p == 'E')) {
+    const char *e = p + 1;
+    bool exp_negative = false;
+    if (*e == '+' || *e == '-') {
+      exp_negative = (*e == '-');
+      e++;
+    }
+    if (isDigit(*e)) {
+      int value = 0;
+      for (; isDigit(*e); e++) {
+        if (value < 100000)
+          value = value * 10 + (*e - '0');
+      }
+      exponent += exp_negative ? -value : value;
+      p = e;
+    }
+  }
 
+  token = start + strcspn(start, " \t\r\n");
+
+  float f;
+  if (any && exact && mantissa <= (1ULL << 24) && exponent >= -10 &&
+      exponent <= 10) {
+    f = (float)mantissa;
+    f = exponent < 0 ? f / pow10f[-exponent] : f * pow10f[exponent];
+  } else if (any && exact && mantissa <= (1ULL << 53) && exponent >= -22 &&
+             exponent <= 22) {
+    double d = (double)mantissa;
+    d = exponent < 0 ? d / pow10d[-exponent] : d * pow10d[exponent];
+    f = (float)d;
+  } else {
+    // Slow path, also covers "inf", "nan" and garbage like atof() did.
+    char buf[128];
+    size_t len = token - start;
+    if (len >= sizeof(buf))
+      len = sizeof(buf) - 1;
+    memcpy(buf, start, len);
+    buf[len] = '\0';
+    return (float)strtod(buf, NULL);
+  }
+  return negative ? -f : f;
+}
 
 static inline void parseFloat2(float &x, float &y, const char *&token) {
   x = parseFloat(token);
@@ -266,7 +484,7 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
   vertex_index vi(-1);
 
   vi.v_idx = fixIndex(atoi(token), vsize);
-  token += strcspn(token, "/ \t\r");
+  token += strcspn(token, "/ \t\r\n");
   if (token[0] != '/') {
     return vi;
   }
@@ -276,13 +494,13 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
   if (token[0] == '/') {
     token++;
     vi.vn_idx = fixIndex(atoi(token), vnsize);
-    token += strcspn(token, "/ \t\r");
+    token += strcspn(token, "/ \t\r\n");
     return vi;
   }
 
   // i/j/k or i/j
   vi.vt_idx = fixIndex(atoi(token), vtsize);
-  token += strcspn(token, "/ \t\r");
+  token += strcspn(token, "/ \t\r\n");
   if (token[0] != '/') {
     return vi;
   }
@@ -290,22 +508,23 @@ static vertex_index parseTriple(const char *&token, int vsize, int vnsize,
   // i/j/k
   token++; // skip '/'
   vi.vn_idx = fixIndex(atoi(token), vnsize);
-  token += strcspn(token, "/ \t\r");
+  token += strcspn(token, "/ \t\r\n");
   return vi;
 }
 
 static unsigned int
-updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
+updateVertex(vertex_cache &vertexCache,
              std::vector<float> &positions, std::vector<float> &normals,
              std::vector<float> &texcoords,
              const std::vector<float> &in_positions,
              const std::vector<float> &in_normals,
              const std::vector<float> &in_texcoords, const vertex_index &i) {
-  const std::map<vertex_index, unsigned int>::iterator it = vertexCache.find(i);
+  bool inserted;
+  unsigned int &cached = vertexCache.find_or_insert(i, inserted);
 
-  if (it != vertexCache.end()) {
+  if (!inserted) {
     // found cache
-    return it->second;
+    return cached;
   }
 
   assert(in_positions.size() > (unsigned int)(3 * i.v_idx + 2));
@@ -326,7 +545,7 @@ updateVertex(std::map<vertex_index, unsigned int> &vertexCache,
   }
 
   unsigned int idx = positions.size() / 3 - 1;
-  vertexCache[i] = idx;
+  cached = idx;
 
   return idx;
 }
@@ -352,7 +571,7 @@ void InitMaterial(material_t &material) {
 }
 
 static bool exportFaceGroupToShape(
-    shape_t &shape, std::map<vertex_index, unsigned int> vertexCache,
+    shape_t &shape, vertex_cache &vertexCache,
     const std::vector<float> &in_positions,
     const std::vector<float> &in_normals,
     const std::vector<float> &in_texcoords,
@@ -362,6 +581,19 @@ static bool exportFaceGroupToShape(
     return false;
   }
 
+  // Size the cache from the face count (about one new vertex per face for
+  // typical meshes), and the index arrays exactly, so neither grows while
+  // flattening.
+  size_t num_triangles = 0;
+  for (size_t i = 0; i < faceGroup.size(); i++) {
+    if (faceGroup[i].size() > 2)
+      num_triangles += faceGroup[i].size() - 2;
+  }
+  vertexCache.reserve(faceGroup.size());
+  shape.mesh.indices.reserve(shape.mesh.indices.size() + num_triangles * 3);
+  shape.mesh.material_ids.reserve(shape.mesh.material_ids.size() +
+                                  num_triangles);
+
   // Flatten vertices and indices
   for (size_t i = 0; i < faceGroup.size(); i++) {
     const std::vector<vertex_index> &face = faceGroup[i];
@@ -403,42 +635,23 @@ static bool exportFaceGroupToShape(
   return true;
 }
 
-std::string LoadMtl(std::map<std::string, int> &material_map,
-                    std::vector<material_t> &materials,
-                    std::istream &inStream) {
+static std::string LoadMtl(std::map<std::string, int> &material_map,
+                           std::vector<material_t> &materials,
+                           const char *begin, const char *end) {
   material_map.clear();
   std::stringstream err;
 
   material_t material;
 
-  int maxchars = 8192;             // Alloc enough size.
-  std::vector<char> buf(maxchars); // Alloc enough size.
-  while (inStream.peek() != -1) {
-    inStream.getline(&buf[0], maxchars);
-
-    std::string linebuf(&buf[0]);
-
-    // Trim newline '\r\n' or '\n'
-    if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size() - 1] == '\n')
-        linebuf.erase(linebuf.size() - 1);
-    }
-    if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size() - 1] == '\r')
-        linebuf.erase(linebuf.size() - 1);
-    }
-
-    // Skip if empty line.
-    if (linebuf.empty()) {
-      continue;
-    }
-
+  line_reader lines(begin, end);
+  const char *line;
+  const char *line_end;
+  while (lines.next(line, line_end)) {
     // Skip leading space.
-    const char *token = linebuf.c_str();
+    const char *token = line;
     token += strspn(token, " \t");
 
-    assert(token);
-    if (token[0] == '\0')
+    if (token >= line_end)
       continue; // empty line
 
     if (token[0] == '#')
@@ -457,10 +670,8 @@ std::string LoadMtl(std::map<std::string, int> &material_map,
       InitMaterial(material);
 
       // set new mtl name
-      char namebuf[4096];
       token += 7;
-      sscanf(token, "%s", namebuf);
-      material.name = namebuf;
+      material.name = parseString(token);
       continue;
     }
 
@@ -555,40 +766,41 @@ std::string LoadMtl(std::map<std::string, int> &material_map,
     // ambient texture
     if ((0 == strncmp(token, "map_Ka", 6)) && isSpace(token[6])) {
       token += 7;
-      material.ambient_texname = token;
+      material.ambient_texname.assign(token, line_end);
       continue;
     }
 
     // diffuse texture
     if ((0 == strncmp(token, "map_Kd", 6)) && isSpace(token[6])) {
       token += 7;
-      material.diffuse_texname = token;
+      material.diffuse_texname.assign(token, line_end);
       continue;
     }
 
     // specular texture
     if ((0 == strncmp(token, "map_Ks", 6)) && isSpace(token[6])) {
       token += 7;
-      material.specular_texname = token;
+      material.specular_texname.assign(token, line_end);
       continue;
     }
 
     // normal texture
     if ((0 == strncmp(token, "map_Ns", 6)) && isSpace(token[6])) {
       token += 7;
-      material.normal_texname = token;
+      material.normal_texname.assign(token, line_end);
       continue;
     }
 
     // unknown parameter
-    const char *_space = strchr(token, ' ');
+    const char *_space =
+        (const char *)memchr(token, ' ', line_end - token);
     if (!_space) {
-      _space = strchr(token, '\t');
+      _space = (const char *)memchr(token, '\t', line_end - token);
     }
     if (_space) {
       int len = _space - token;
       std::string key(token, len);
-      std::string value = _space + 1;
+      std::string value(_space + 1, line_end);
       material.unknown_parameter.insert(
           std::pair<std::string, std::string>(key, value));
     }
@@ -601,6 +813,21 @@ std::string LoadMtl(std::map<std::string, int> &material_map,
   return err.str();
 }
 
+// Reads a whole stream into memory, for the std::istream entry points.
+static void readStream(std::istream &inStream, std::vector<char> &buffer) {
+  buffer.assign(std::istreambuf_iterator<char>(inStream),
+                std::istreambuf_iterator<char>());
+}
+
+std::string LoadMtl(std::map<std::string, int> &material_map,
+                    std::vector<material_t> &materials,
+                    std::istream &inStream) {
+  std::vector<char> buffer;
+  readStream(inStream, buffer);
+  const char *begin = buffer.empty() ? NULL : &buffer[0];
+  return LoadMtl(material_map, materials, begin, begin + buffer.size());
+}
+
 std::string MaterialFileReader::operator()(const std::string &matId,
                                            std::vector<material_t> &materials,
                                            std::map<std::string, int> &matMap) {
@@ -612,10 +839,17 @@ std::string MaterialFileReader::operator()(const std::string &matId,
     filepath = matId;
   }
 
-  std::ifstream matIStream(filepath.c_str());
-  return LoadMtl(matMap, materials, matIStream);
+  // A missing file is parsed as an empty one, like an unopened stream was.
+  mapped_file file;
+  file.open(filepath.c_str());
+  return LoadMtl(matMap, materials, file.begin(), file.end());
 }
 
+static std::string LoadObj(std::vector<shape_t> &shapes,
+                           std::vector<material_t> &materials,
+                           const char *begin, const char *end,
+                           MaterialReader &readMatFn);
+
 std::string LoadObj(std::vector<shape_t> &shapes,
                     std::vector<material_t> &materials, // [output]
                     const char *filename, const char *mtl_basepath) {
@@ -624,8 +858,8 @@ std::string LoadObj(std::vector<shape_t> &shapes,
 
   std::stringstream err;
 
-  std::ifstream ifs(filename);
-  if (!ifs) {
+  mapped_file file;
+  if (!file.open(filename)) {
     err << "Cannot open file [" << filename << "]" << std::endl;
     return err.str();
   }
@@ -636,12 +870,22 @@ std::string LoadObj(std::vector<shape_t> &shapes,
   }
   MaterialFileReader matFileReader(basePath);
 
-  return LoadObj(shapes, materials, ifs, matFileReader);
+  return LoadObj(shapes, materials, file.begin(), file.end(), matFileReader);
 }
 
 std::string LoadObj(std::vector<shape_t> &shapes,
                     std::vector<material_t> &materials, // [output]
                     std::istream &inStream, MaterialReader &readMatFn) {
+  std::vector<char> buffer;
+  readStream(inStream, buffer);
+  const char *begin = buffer.empty() ? NULL : &buffer[0];
+  return LoadObj(shapes, materials, begin, begin + buffer.size(), readMatFn);
+}
+
+static std::string LoadObj(std::vector<shape_t> &shapes,
+                           std::vector<material_t> &materials, // [output]
+                           const char *begin, const char *end,
+                           MaterialReader &readMatFn) {
   std::stringstream err;
 
   std::vector<float> v;
@@ -652,39 +896,20 @@ std::string LoadObj(std::vector<shape_t> &shapes,
 
   // material
   std::map<std::string, int> material_map;
-  std::map<vertex_index, unsigned int> vertexCache;
+  vertex_cache vertexCache;
   int material = -1;
 
   shape_t shape;
 
-  int maxchars = 8192;             // Alloc enough size.
-  std::vector<char> buf(maxchars); // Alloc enough size.
-  while (inStream.peek() != -1) {
-    inStream.getline(&buf[0], maxchars);
-
-    std::string linebuf(&buf[0]);
-
-    // Trim newline '\r\n' or '\n'
-    if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size() - 1] == '\n')
-        linebuf.erase(linebuf.size() - 1);
-    }
-    if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size() - 1] == '\r')
-        linebuf.erase(linebuf.size() - 1);
-    }
-
-    // Skip if empty line.
-    if (linebuf.empty()) {
-      continue;
-    }
-
+  line_reader lines(begin, end);
+  const char *line;
+  const char *line_end;
+  while (lines.next(line, line_end)) {
     // Skip leading space.
-    const char *token = linebuf.c_str();
+    const char *token = line;
     token += strspn(token, " \t");
 
-    assert(token);
-    if (token[0] == '\0')
+    if (token >= line_end)
       continue; // empty line
 
     if (token[0] == '#')
@@ -744,9 +969,8 @@ std::string LoadObj(std::vector<shape_t> &shapes,
     // use mtl
     if ((0 == strncmp(token, "usemtl", 6)) && isSpace((token[6]))) {
 
-      char namebuf[4096];
       token += 7;
-      sscanf(token, "%s", namebuf);
+      std::string namebuf = parseString(token);
 
       // Create face group per material.
       bool ret = exportFaceGroupToShape(shape, vertexCache, v, vn, vt,
@@ -770,9 +994,8 @@ std::string LoadObj(std::vector<shape_t> &shapes,
 
     // load mtl
     if ((0 == strncmp(token, "mtllib", 6)) && isSpace((token[6]))) {
-      char namebuf[4096];
       token += 7;
-      sscanf(token, "%s", namebuf);
+      std::string namebuf = parseString(token);
 
       std::string err_mtl = readMatFn(namebuf, materials, material_map);
       if (!err_mtl.empty()) {
@@ -832,10 +1055,8 @@ std::string LoadObj(std::vector<shape_t> &shapes,
       shape = shape_t();
 
       // @todo { multiple object name? }
-      char namebuf[4096];
       token += 2;
-      sscanf(token, "%s", namebuf);
-      name = std::string(namebuf);
+      name = parseString(token);
 
       continue;
     }
@@ -852,4 +1073,712 @@ std::string LoadObj(std::vector<shape_t> &shapes,
 
   return err.str();
 }
+
+// Streams an .obj in two passes over the mapped file. The first one reads
+// the vertex arrays and materials, so the bounds are known before any
+// triangle is handed out. The second one resolves the faces.
+std::string LoadObjStreamed(const char *filename, TriangleSink &sink,
+                            size_t batch_triangles, const char *mtl_basepath) {
+  std::stringstream err;
+
+  mapped_file file;
+  if (!file.open(filename)) {
+    err << "Cannot open file [" << filename << "]" << std::endl;
+    return err.str();
+  }
+
+  std::string basePath;
+  if (mtl_basepath) {
+    basePath = mtl_basepath;
+  }
+  MaterialFileReader matFileReader(basePath);
+
+  std::vector<float> v;
+  std::vector<float> vt;
+  std::vector<material_t> materials;
+  std::map<std::string, int> material_map;
+
+  const char *line;
+  const char *line_end;
+
+  // Pass 1: vertices and materials.
+  {
+    line_reader lines(file.begin(), file.end());
+    while (lines.next(line, line_end)) {
+      const char *token = line;
+      token += strspn(token, " \t");
+
+      if (token[0] == 'v' && isSpace((token[1]))) {
+        token += 2;
+        float x, y, z;
+        parseFloat3(x, y, z, token);
+        v.push_back(x);
+        v.push_back(y);
+        v.push_back(z);
+        continue;
+      }
+
+      if (token[0] == 'v' && token[1] == 't' && isSpace((token[2]))) {
+        token += 3;
+        float x, y;
+        parseFloat2(x, y, token);
+        vt.push_back(x);
+        vt.push_back(y);
+        continue;
+      }
+
+      if ((0 == strncmp(token, "mtllib", 6)) && isSpace((token[6]))) {
+        token += 7;
+        std::string namebuf = parseString(token);
+
+        std::string err_mtl = matFileReader(namebuf, materials, material_map);
+        if (!err_mtl.empty()) {
+          return err_mtl;
+        }
+      }
+    }
+  }
+
+  float bmin[3] = {0.0f, 0.0f, 0.0f};
+  float bmax[3] = {0.0f, 0.0f, 0.0f};
+  for (size_t i = 0; i < v.size(); i++) {
+    float f = v[i];
+    size_t c = i % 3;
+    if (i < 3 || f < bmin[c])
+      bmin[c] = f;
+    if (i < 3 || f > bmax[c])
+      bmax[c] = f;
+  }
+  sink.Begin(bmin, bmax, materials);
+
+  // Pass 2: faces. Relative indices refer to the vertices defined so far, so
+  // the vertex lines are still counted.
+  if (batch_triangles == 0)
+    batch_triangles = 1;
+  std::vector<float> batch(batch_triangles * 15);
+  triangle_batch_t out;
+  out.vertices = &batch[0];
+  out.num_triangles = 0;
+  out.material_id = -1;
+
+  int num_v = 0;
+  int num_vn = 0;
+  int num_vt = 0;
+  std::vector<vertex_index> face;
+
+  line_reader lines(file.begin(), file.end());
+  while (lines.next(line, line_end)) {
+    const char *token = line;
+    token += strspn(token, " \t");
+
+    if (token[0] == 'v') {
+      if (isSpace(token[1]))
+        num_v++;
+      else if (token[1] == 't' && isSpace(token[2]))
+        num_vt++;
+      else if (token[1] == 'n' && isSpace(token[2]))
+        num_vn++;
+      continue;
+    }
+
+    if (token[0] == 'f' && isSpace((token[1]))) {
+      token += 2;
+      token += strspn(token, " \t");
+
+      face.clear();
+      while (!isNewLine(token[0])) {
+        // Normals are not streamed, but relative vn indices still resolve
+        // against the normals defined so far.
+        face.push_back(parseTriple(token, num_v, num_vn, num_vt));
+        token += strspn(token, " \t\r");
+      }
+
+      for (size_t k = 2; k < face.size(); k++) {
+        const vertex_index corners[3] = {face[0], face[k - 1], face[k]};
+        float *dst = &batch[out.num_triangles * 15];
+        for (int c = 0; c < 3; c++, dst += 5) {
+          const vertex_index &vi = corners[c];
+          if (vi.v_idx < 0 || (size_t)vi.v_idx * 3 + 2 >= v.size()) {
+            err << "Vertex index out of range in [" << filename << "]"
+                << std::endl;
+            return err.str();
+          }
+          memcpy(dst, &v[vi.v_idx * 3], sizeof(float) * 3);
+          if (vi.vt_idx >= 0 && (size_t)vi.vt_idx * 2 + 1 < vt.size()) {
+            dst[3] = vt[vi.vt_idx * 2 + 0];
+            dst[4] = vt[vi.vt_idx * 2 + 1];
+          } else {
+            dst[3] = dst[4] = 0.0f;
+          }
+        }
+
+        if (++out.num_triangles == batch_triangles) {
+          sink.Consume(out);
+          out.num_triangles = 0;
+        }
+      }
+      continue;
+    }
+
+    if ((0 == strncmp(token, "usemtl", 6)) && isSpace((token[6]))) {
+      token += 7;
+      std::string namebuf = parseString(token);
+
+      if (out.num_triangles) {
+        sink.Consume(out);
+        out.num_triangles = 0;
+      }
+
+      std::map<std::string, int>::const_iterator it =
+          material_map.find(namebuf);
+      out.material_id = (it != material_map.end()) ? it->second : -1;
+    }
+  }
+
+  if (out.num_triangles)
+    sink.Consume(out);
+
+  return err.str();
+}
+
+// Binary mesh cache.
+//
+// Layout, all integers in native byte order:
+//   cache_header
+//   meta block:  dependency stamps, material table, shape names
+//   shape table: one cache_shape per shape
+//   arrays:      16 byte aligned, referenced by the shape table
+//
+// The cache is a local acceleration structure, it is not meant to be moved
+// between machines. Anything that does not match exactly is rebuilt.
+
+static const char kCacheMagic[8] = {'T', 'O', 'B', 'J', 'C', 'A', 'C', 'H'};
+static const unsigned int kCacheVersion = 1;
+static const unsigned int kCacheByteOrder = 0x01020304;
+
+enum { CACHE_POSITIONS, CACHE_NORMALS, CACHE_TEXCOORDS, CACHE_INDICES,
+       CACHE_MATERIAL_IDS, CACHE_ARRAYS };
+
+struct cache_header {
+  char magic[8];
+  unsigned int version;
+  unsigned int byte_order;
+  unsigned long long meta_offset;
+  unsigned long long meta_size;
+  unsigned long long table_offset;
+  unsigned long long num_shapes;
+};
+
+struct cache_shape {
+  unsigned long long offset[CACHE_ARRAYS]; // in bytes, from the file start
+  unsigned long long count[CACHE_ARRAYS];  // in elements of 4 bytes
+};
+
+// Size, modification time and content fingerprint of a file. A missing file
+// gets a stamp that never matches an existing one.
+struct file_stamp {
+  std::string path;
+  unsigned long long size;
+  unsigned long long mtime;
+  unsigned long long hash;
+
+  bool operator==(const file_stamp &rhs) const {
+    return size == rhs.size && mtime == rhs.mtime && hash == rhs.hash;
+  }
+};
+
+static unsigned long long hashBytes(const char *p, size_t n,
+                                    unsigned long long h) {
+  // FNV-1a
+  for (size_t i = 0; i < n; i++) {
+    h ^= (unsigned char)p[i];
+    h *= 0x100000001b3ULL;
+  }
+  return h;
+}
+
+// Hashes the whole file when it is small, otherwise 64 evenly spaced 4KB
+// blocks including the first and the last one. Together with size and
+// modification time this catches edits, without reading gigabytes of .obj
+// on every start.
+static unsigned long long fingerprint(const char *data, size_t size) {
+  const size_t block = 4096;
+  const size_t samples = 64;
+
+  unsigned long long h = 0xcbf29ce484222325ULL;
+  if (size <= block * samples)
+    return hashBytes(data, size, h);
+
+  size_t step = (size - block) / (samples - 1);
+  for (size_t i = 0; i < samples; i++)
+    h = hashBytes(data + i * step, block, h);
+  return h;
+}
+
+static bool getFileTime(const char *path, unsigned long long &size,
+                        unsigned long long &mtime) {
+#ifdef _WIN32
+  WIN32_FILE_ATTRIBUTE_DATA data;
+  if (!GetFileAttributesExA(path, GetFileExInfoStandard, &data))
+    return false;
+  size = ((unsigned long long)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+  mtime = ((unsigned long long)data.ftLastWriteTime.dwHighDateTime << 32) |
+          data.ftLastWriteTime.dwLowDateTime;
+#else
+  struct stat st;
+  if (stat(path, &st) != 0)
+    return false;
+  size = (unsigned long long)st.st_size;
+  mtime = (unsigned long long)st.st_mtime;
+#endif
+  return true;
+}
+
+static file_stamp getFileStamp(const std::string &path,
+                               const mapped_file *opened = NULL) {
+  file_stamp stamp;
+  stamp.path = path;
+  stamp.size = stamp.mtime = stamp.hash = ~0ULL;
+
+  if (!getFileTime(path.c_str(), stamp.size, stamp.mtime))
+    return stamp;
+
+  mapped_file file;
+  if (opened == NULL) {
+    if (!file.open(path.c_str()))
+      return stamp;
+    opened = &file;
+  }
+  stamp.hash = fingerprint(opened->begin(), opened->size());
+  return stamp;
+}
+
+// Material reader that remembers which files it loaded, so they become part
+// of the cache key.
+class recording_material_reader : public MaterialReader {
+public:
+  recording_material_reader(const std::string &mtl_basepath)
+      : m_mtlBasePath(mtl_basepath), m_reader(mtl_basepath) {}
+
+  virtual std::string operator()(const std::string &matId,
+                                 std::vector<material_t> &materials,
+                                 std::map<std::string, int> &matMap) {
+    m_paths.push_back(m_mtlBasePath + matId);
+    return m_reader(matId, materials, matMap);
+  }
+
+  const std::vector<std::string> &paths() const { return m_paths; }
+
+private:
+  std::string m_mtlBasePath;
+  MaterialFileReader m_reader;
+  std::vector<std::string> m_paths;
+};
+
+class blob_writer {
+public:
+  void u32(unsigned int v) { data.append((const char *)&v, sizeof(v)); }
+  void u64(unsigned long long v) { data.append((const char *)&v, sizeof(v)); }
+  void floats(const float *v, size_t n) {
+    data.append((const char *)v, n * sizeof(float));
+  }
+  void str(const std::string &s) {
+    u32((unsigned int)s.size());
+    data.append(s);
+  }
+
+  std::string data;
+};
+
+// Bounds checked counterpart of blob_writer. Once a read runs past the end,
+// ok() is false and every further read returns zeros.
+class blob_reader {
+public:
+  blob_reader(const char *begin, const char *end)
+      : m_cur(begin), m_end(end), m_ok(true) {}
+
+  bool ok() const { return m_ok; }
+
+  unsigned int u32() {
+    unsigned int v = 0;
+    read(&v, sizeof(v));
+    return v;
+  }
+  unsigned long long u64() {
+    unsigned long long v = 0;
+    read(&v, sizeof(v));
+    return v;
+  }
+  void floats(float *v, size_t n) { read(v, n * sizeof(float)); }
+  std::string str() {
+    size_t n = u32();
+    if (!m_ok || (size_t)(m_end - m_cur) < n) {
+      m_ok = false;
+      return std::string();
+    }
+    std::string s(m_cur, n);
+    m_cur += n;
+    return s;
+  }
+
+private:
+  void read(void *dst, size_t n) {
+    if (!m_ok || (size_t)(m_end - m_cur) < n) {
+      m_ok = false;
+      memset(dst, 0, n);
+      return;
+    }
+    memcpy(dst, m_cur, n);
+    m_cur += n;
+  }
+
+  const char *m_cur;
+  const char *m_end;
+  bool m_ok;
+};
+
+static void writeMaterial(blob_writer &w, const material_t &m) {
+  w.str(m.name);
+  w.floats(m.ambient, 3);
+  w.floats(m.diffuse, 3);
+  w.floats(m.specular, 3);
+  w.floats(m.transmittance, 3);
+  w.floats(m.emission, 3);
+  w.floats(&m.shininess, 1);
+  w.floats(&m.ior, 1);
+  w.floats(&m.dissolve, 1);
+  w.u32((unsigned int)m.illum);
+  w.str(m.ambient_texname);
+  w.str(m.diffuse_texname);
+  w.str(m.specular_texname);
+  w.str(m.normal_texname);
+  w.u32((unsigned int)m.unknown_parameter.size());
+  for (std::map<std::string, std::string>::const_iterator i =
+           m.unknown_parameter.begin();
+       i != m.unknown_parameter.end(); ++i) {
+    w.str(i->first);
+    w.str(i->second);
+  }
+}
+
+static void readMaterial(blob_reader &r, material_t &m) {
+  m.name = r.str();
+  r.floats(m.ambient, 3);
+  r.floats(m.diffuse, 3);
+  r.floats(m.specular, 3);
+  r.floats(m.transmittance, 3);
+  r.floats(m.emission, 3);
+  r.floats(&m.shininess, 1);
+  r.floats(&m.ior, 1);
+  r.floats(&m.dissolve, 1);
+  m.illum = (int)r.u32();
+  m.ambient_texname = r.str();
+  m.diffuse_texname = r.str();
+  m.specular_texname = r.str();
+  m.normal_texname = r.str();
+  m.unknown_parameter.clear();
+  unsigned int count = r.u32();
+  for (unsigned int i = 0; i < count && r.ok(); i++) {
+    std::string key = r.str();
+    m.unknown_parameter[key] = r.str();
+  }
+}
+
+static unsigned long long alignCacheOffset(unsigned long long offset) {
+  return (offset + 15) & ~15ULL;
+}
+
+static bool writePadding(FILE *fp, unsigned long long &offset) {
+  static const char zeros[16] = {0};
+  unsigned long long aligned = alignCacheOffset(offset);
+  size_t n = (size_t)(aligned - offset);
+  offset = aligned;
+  return n == 0 || fwrite(zeros, 1, n, fp) == n;
+}
+
+static bool writeCache(const std::string &cachename,
+                       const std::vector<file_stamp> &stamps,
+                       const std::vector<shape_t> &shapes,
+                       const std::vector<material_t> &materials) {
+  blob_writer meta;
+  meta.u32((unsigned int)stamps.size());
+  for (size_t i = 0; i < stamps.size(); i++) {
+    meta.str(stamps[i].path);
+    meta.u64(stamps[i].size);
+    meta.u64(stamps[i].mtime);
+    meta.u64(stamps[i].hash);
+  }
+  meta.u32((unsigned int)materials.size());
+  for (size_t i = 0; i < materials.size(); i++)
+    writeMaterial(meta, materials[i]);
+  for (size_t i = 0; i < shapes.size(); i++)
+    meta.str(shapes[i].name);
+
+  cache_header header;
+  memcpy(header.magic, kCacheMagic, sizeof(kCacheMagic));
+  header.version = kCacheVersion;
+  header.byte_order = kCacheByteOrder;
+  header.meta_offset = sizeof(cache_header);
+  header.meta_size = meta.data.size();
+  header.table_offset =
+      alignCacheOffset(header.meta_offset + header.meta_size);
+  header.num_shapes = shapes.size();
+
+  // Lay out the arrays behind the shape table.
+  std::vector<cache_shape> table(shapes.size());
+  unsigned long long offset =
+      header.table_offset + shapes.size() * sizeof(cache_shape);
+  for (size_t i = 0; i < shapes.size(); i++) {
+    const mesh_t &mesh = shapes[i].mesh;
+    table[i].count[CACHE_POSITIONS] = mesh.positions.size();
+    table[i].count[CACHE_NORMALS] = mesh.normals.size();
+    table[i].count[CACHE_TEXCOORDS] = mesh.texcoords.size();
+    table[i].count[CACHE_INDICES] = mesh.indices.size();
+    table[i].count[CACHE_MATERIAL_IDS] = mesh.material_ids.size();
+    for (int a = 0; a < CACHE_ARRAYS; a++) {
+      offset = alignCacheOffset(offset);
+      table[i].offset[a] = offset;
+      offset += table[i].count[a] * 4;
+    }
+  }
+
+  FILE *fp = fopen(cachename.c_str(), "wb");
+  if (!fp)
+    return false;
+
+  bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+            fwrite(meta.data.data(), 1, meta.data.size(), fp) ==
+                meta.data.size();
+  offset = header.meta_offset + header.meta_size;
+  ok = ok && writePadding(fp, offset);
+  if (ok && !table.empty())
+    ok = fwrite(&table[0], sizeof(cache_shape), table.size(), fp) ==
+         table.size();
+  offset += table.size() * sizeof(cache_shape);
+
+  for (size_t i = 0; i < shapes.size() && ok; i++) {
+    const mesh_t &mesh = shapes[i].mesh;
+    const void *arrays[CACHE_ARRAYS] = {
+        mesh.positions.empty() ? NULL : &mesh.positions[0],
+        mesh.normals.empty() ? NULL : &mesh.normals[0],
+        mesh.texcoords.empty() ? NULL : &mesh.texcoords[0],
+        mesh.indices.empty() ? NULL : &mesh.indices[0],
+        mesh.material_ids.empty() ? NULL : &mesh.material_ids[0]};
+    for (int a = 0; a < CACHE_ARRAYS && ok; a++) {
+      ok = writePadding(fp, offset);
+      size_t count = (size_t)table[i].count[a];
+      if (ok && count)
+        ok = fwrite(arrays[a], 4, count, fp) == count;
+      offset += count * 4;
+    }
+  }
+
+  return (fclose(fp) == 0) && ok;
+}
+
+static bool replaceFile(const std::string &from, const std::string &to) {
+#ifdef _WIN32
+  return MoveFileExA(from.c_str(), to.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+  return rename(from.c_str(), to.c_str()) == 0;
+#endif
+}
+
+MeshCache::MeshCache() : m_file(new mapped_file()), m_hit(false) {}
+
+MeshCache::~MeshCache() { delete m_file; }
+
+void MeshCache::Close() {
+  m_file->close();
+  m_hit = false;
+  m_views.clear();
+  m_materials.clear();
+  m_shapes.clear();
+}
+
+// Maps 'cachename' and sets up the views, if it is a valid cache for the
+// current state of 'objname' and its materials.
+bool MeshCache::Map(const std::string &cachename, const char *objname) {
+  if (!m_file->open(cachename.c_str()))
+    return false;
+
+  const char *base = m_file->begin();
+  unsigned long long size = m_file->size();
+
+  cache_header header;
+  if (size < sizeof(header)) {
+    m_file->close();
+    return false;
+  }
+  memcpy(&header, base, sizeof(header));
+  if (memcmp(header.magic, kCacheMagic, sizeof(kCacheMagic)) != 0 ||
+      header.version != kCacheVersion ||
+      header.byte_order != kCacheByteOrder ||
+      header.meta_offset > size || header.meta_size > size - header.meta_offset ||
+      header.table_offset > size ||
+      header.num_shapes > (size - header.table_offset) / sizeof(cache_shape)) {
+    m_file->close();
+    return false;
+  }
+
+  blob_reader meta(base + header.meta_offset,
+                   base + header.meta_offset + header.meta_size);
+
+  // Dependencies, the first one is the .obj itself. It is checked under the
+  // name it is opened with now, in case the working directory changed.
+  unsigned int num_stamps = meta.u32();
+  bool valid = num_stamps > 0;
+  for (unsigned int i = 0; i < num_stamps && valid && meta.ok(); i++) {
+    file_stamp stamp;
+    stamp.path = meta.str();
+    stamp.size = meta.u64();
+    stamp.mtime = meta.u64();
+    stamp.hash = meta.u64();
+    valid = meta.ok() &&
+            getFileStamp(i == 0 ? std::string(objname) : stamp.path) == stamp;
+  }
+
+  std::vector<material_t> materials;
+  if (valid) {
+    materials.resize(meta.u32());
+    for (size_t i = 0; i < materials.size() && meta.ok(); i++)
+      readMaterial(meta, materials[i]);
+  }
+
+  std::vector<shape_view_t> views;
+  if (valid) {
+    views.resize((size_t)header.num_shapes);
+    const cache_shape *table =
+        (const cache_shape *)(base + header.table_offset);
+    for (size_t i = 0; i < views.size() && valid; i++) {
+      views[i].name = meta.str();
+
+      const void *arrays[CACHE_ARRAYS];
+      for (int a = 0; a < CACHE_ARRAYS; a++) {
+        unsigned long long offset = table[i].offset[a];
+        unsigned long long count = table[i].count[a];
+        valid = valid && offset <= size && count <= (size - offset) / 4;
+        arrays[a] = count ? base + offset : NULL;
+      }
+      views[i].positions = (const float *)arrays[CACHE_POSITIONS];
+      views[i].normals = (const float *)arrays[CACHE_NORMALS];
+      views[i].texcoords = (const float *)arrays[CACHE_TEXCOORDS];
+      views[i].indices = (const unsigned int *)arrays[CACHE_INDICES];
+      views[i].material_ids = (const int *)arrays[CACHE_MATERIAL_IDS];
+      views[i].num_positions = (size_t)table[i].count[CACHE_POSITIONS];
+      views[i].num_normals = (size_t)table[i].count[CACHE_NORMALS];
+      views[i].num_texcoords = (size_t)table[i].count[CACHE_TEXCOORDS];
+      views[i].num_indices = (size_t)table[i].count[CACHE_INDICES];
+      views[i].num_material_ids = (size_t)table[i].count[CACHE_MATERIAL_IDS];
+    }
+  }
+
+  if (!valid || !meta.ok()) {
+    m_file->close();
+    return false;
+  }
+
+  m_views.swap(views);
+  m_materials.swap(materials);
+  return true;
+}
+
+// Points the views at m_shapes, when the parsed data could not be cached.
+void MeshCache::UseShapes() {
+  m_views.resize(m_shapes.size());
+  for (size_t i = 0; i < m_shapes.size(); i++) {
+    const mesh_t &mesh = m_shapes[i].mesh;
+    shape_view_t &view = m_views[i];
+    view.name = m_shapes[i].name;
+    view.positions = mesh.positions.empty() ? NULL : &mesh.positions[0];
+    view.normals = mesh.normals.empty() ? NULL : &mesh.normals[0];
+    view.texcoords = mesh.texcoords.empty() ? NULL : &mesh.texcoords[0];
+    view.indices = mesh.indices.empty() ? NULL : &mesh.indices[0];
+    view.material_ids =
+        mesh.material_ids.empty() ? NULL : &mesh.material_ids[0];
+    view.num_positions = mesh.positions.size();
+    view.num_normals = mesh.normals.size();
+    view.num_texcoords = mesh.texcoords.size();
+    view.num_indices = mesh.indices.size();
+    view.num_material_ids = mesh.material_ids.size();
+  }
+}
+
+std::string MeshCache::Open(const char *filename, const char *mtl_basepath) {
+  Close();
+
+  std::string cachename = std::string(filename) + ".cache";
+  if (Map(cachename, filename)) {
+    m_hit = true;
+    return std::string();
+  }
+
+  std::stringstream err;
+  mapped_file file;
+  if (!file.open(filename)) {
+    err << "Cannot open file [" << filename << "]" << std::endl;
+    return err.str();
+  }
+
+  // Stamp before parsing, an edit during the parse then invalidates the
+  // cache on the next run.
+  std::vector<file_stamp> stamps;
+  stamps.push_back(getFileStamp(filename, &file));
+
+  recording_material_reader matFileReader(mtl_basepath ? mtl_basepath : "");
+  std::string err_obj = LoadObj(m_shapes, m_materials, file.begin(),
+                                file.end(), matFileReader);
+  file.close();
+  if (!err_obj.empty()) {
+    Close();
+    return err_obj;
+  }
+
+  for (size_t i = 0; i < matFileReader.paths().size(); i++)
+    stamps.push_back(getFileStamp(matFileReader.paths()[i]));
+
+  // Write to a temporary file first, a half written cache must never be
+  // picked up by another process.
+  std::string tmpname = cachename + ".tmp";
+  if (writeCache(tmpname, stamps, m_shapes, m_materials) &&
+      replaceFile(tmpname, cachename) && Map(cachename, filename)) {
+    std::vector<shape_t>().swap(m_shapes);
+    return std::string();
+  }
+  remove(tmpname.c_str());
+
+  // The cache could not be written (read only directory, disk full...), so
+  // serve the parsed data directly.
+  UseShapes();
+  return std::string();
+}
+
+std::string LoadObjCached(std::vector<shape_t> &shapes,
+                          std::vector<material_t> &materials,
+                          const char *filename, const char *mtl_basepath) {
+  shapes.clear();
+
+  MeshCache cache;
+  std::string err = cache.Open(filename, mtl_basepath);
+  if (!err.empty())
+    return err;
+
+  const std::vector<shape_view_t> &views = cache.GetShapes();
+  shapes.resize(views.size());
+  for (size_t i = 0; i < views.size(); i++) {
+    const shape_view_t &view = views[i];
+    mesh_t &mesh = shapes[i].mesh;
+    shapes[i].name = view.name;
+    mesh.positions.assign(view.positions, view.positions + view.num_positions);
+    mesh.normals.assign(view.normals, view.normals + view.num_normals);
+    mesh.texcoords.assign(view.texcoords, view.texcoords + view.num_texcoords);
+    mesh.indices.assign(view.indices, view.indices + view.num_indices);
+    mesh.material_ids.assign(view.material_ids,
+                             view.material_ids + view.num_material_ids);
+  }
+
+  materials.insert(materials.end(), cache.GetMaterials().begin(),
+                   cache.GetMaterials().end());
+  return std::string();
+}
 }
@@ -6,11 +6,10 @@
 #ifndef _TINY_OBJ_LOADER_H
 #define _TINY_OBJ_LOADER_H
 
-#define TINY_OBJ_LOADER_OLD_FLOAT_PARSER
-
 #include <string>
 #include <vector>
 #include <map>
+#include <cstddef>
 
 namespace tinyobj {
 
@@ -72,6 +71,8 @@ private:
 };
 
 /// Loads .obj from a file.
+/// The file (and any .mtl it references) is memory mapped and parsed in
+/// place.
 /// 'shapes' will be filled with parsed shape data
 /// The function returns error string.
 /// Returns empty string when loading .obj success.
@@ -82,6 +83,7 @@ std::string LoadObj(std::vector<shape_t> &shapes,       // [output]
 
 /// Loads object from a std::istream, uses GetMtlIStreamFn to retrieve
 /// std::istream for materials.
+/// The stream is read into memory first, prefer the file version.
 /// Returns empty string when loading .obj success.
 std::string LoadObj(std::vector<shape_t> &shapes,       // [output]
                     std::vector<material_t> &materials, // [output]
@@ -91,6 +93,101 @@ std::string LoadObj(std::vector<shape_t> &shapes,       // [output]
 /// Returns an empty string if successful
 std::string LoadMtl(std::map<std::string, int> &material_map,
                     std::vector<material_t> &materials, std::istream &inStream);
+
+/// Triangles handed out by LoadObjStreamed(). All triangles of a batch use
+/// the same material.
+typedef struct {
+  const float *vertices; // 3 vertices per triangle, 5 floats each: x y z u v
+  size_t num_triangles;
+  int material_id;
+} triangle_batch_t;
+
+class TriangleSink {
+public:
+  TriangleSink() {}
+  virtual ~TriangleSink() {}
+
+  /// Called once before the first batch, with the bounds of all vertices and
+  /// the material table.
+  virtual void Begin(const float bmin[3], const float bmax[3],
+                     const std::vector<material_t> &materials) = 0;
+  /// The batch memory is reused as soon as this returns.
+  virtual void Consume(const triangle_batch_t &batch) = 0;
+};
+
+/// Streams the triangles of an .obj to 'sink' in batches of at most
+/// 'batch_triangles', without building shapes.
+/// Only the 'v' and 'vt' arrays and one batch are kept in memory. Normals,
+/// groups and objects are ignored, polygons are split into triangle fans.
+/// Returns an empty string when successful.
+std::string LoadObjStreamed(const char *filename, TriangleSink &sink,
+                            size_t batch_triangles = 65536,
+                            const char *mtl_basepath = NULL);
+
+/// Shape data of a MeshCache. The arrays have the same layout and sizes as
+/// the vectors of mesh_t, and point into the cache.
+typedef struct {
+  std::string name;
+  const float *positions;
+  const float *normals;
+  const float *texcoords;
+  const unsigned int *indices;
+  const int *material_ids;
+  size_t num_positions; // number of floats, 3 per vertex
+  size_t num_normals;
+  size_t num_texcoords;
+  size_t num_indices;
+  size_t num_material_ids; // one per triangle
+} shape_view_t;
+
+class mapped_file;
+
+/// Binary cache of a parsed .obj, stored next to it as "<filename>.cache".
+///
+/// The cache holds the flattened shapes and the resolved material table,
+/// keyed by the size, modification time and a content fingerprint of the
+/// .obj and of every .mtl it loaded. Open() memory maps a matching cache and
+/// hands out views into it, so nothing is parsed or copied. A missing or
+/// stale cache is rebuilt from the .obj first.
+class MeshCache {
+public:
+  MeshCache();
+  ~MeshCache();
+
+  /// Returns an empty string when successful.
+  std::string Open(const char *filename, const char *mtl_basepath = NULL);
+  void Close();
+
+  /// True when the last Open() was served from an existing cache.
+  bool IsHit() const { return m_hit; }
+
+  const std::vector<shape_view_t> &GetShapes() const { return m_views; }
+  const std::vector<material_t> &GetMaterials() const { return m_materials; }
+
+private:
+  MeshCache(const MeshCache &);
+  MeshCache &operator=(const MeshCache &);
+
+  bool Map(const std::string &cachename, const char *objname);
+  void UseShapes();
+
+  mapped_file *m_file;
+  bool m_hit;
+  std::vector<shape_view_t> m_views;
+  std::vector<material_t> m_materials;
+  // Only used when the cache could not be written.
+  std::vector<shape_t> m_shapes;
+};
+
+/// Loads .obj like LoadObj(), through a MeshCache.
+/// The shapes are copied out of the cache into the vectors of mesh_t, for
+/// callers that need shape_t. Keep a MeshCache open and use its views to
+/// avoid the copy.
+/// Returns an empty string when successful.
+std::string LoadObjCached(std::vector<shape_t> &shapes,       // [output]
+                          std::vector<material_t> &materials, // [output]
+                          const char *filename,
+                          const char *mtl_basepath = NULL);
 }
 
 #endif // _TINY_OBJ_LOADER_H
@@ -3,6 +3,8 @@
 #include <vector>
 #include <algorithm>
 #include "AHDd3d11Helper.h"
+#include "AHDParallel.h"
+#include "AHDException.h"
 #include <d3dcompiler.h>
 
 #undef max
@@ -13,8 +15,6 @@ using namespace AHD;
 #pragma comment (lib,"d3d11.lib")
 #pragma comment (lib,"d3dx11.lib")
 
-#define EXCEPT(x) {throw std::exception(x);}
-
 #define CHECK_RESULT(x, y) { if (FAILED(x)) EXCEPT(y); }
 #define SAFE_RELEASE(x) {if(x) (x)->Release(); (x) = 0;}
 
@@ -22,16 +22,25 @@ using namespace AHD;
 typedef D3D11Helper Helper;
 
 
+void Effect::setPositionFormat(PositionFormat format)
+{
+	if (format != PF_FLOAT3)
+		EXCEPT("the effect cant read this position format");
+}
+
 void DefaultEffect::init(ID3D11Device* device)
 {
 	{
 		D3D11_INPUT_ELEMENT_DESC desc[] = { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 };
+		D3D11_INPUT_ELEMENT_DESC descSnorm16[] = { "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 };
 
 		ID3DBlob* blob;
 		CHECK_RESULT(Helper::compileShader(&blob, "DefaultEffect.hlsl", "vs", "vs_5_0", NULL), 
 					 "fail to compile vertex shader, cant use gpu voxelizer");
 		CHECK_RESULT(device->CreateInputLayout(desc, ARRAYSIZE(desc), blob->GetBufferPointer(), blob->GetBufferSize(), &mLayout), 
 					 "fail to create mLayout,  cant use gpu voxelizer");
+		CHECK_RESULT(device->CreateInputLayout(descSnorm16, ARRAYSIZE(descSnorm16), blob->GetBufferPointer(), blob->GetBufferSize(), &mLayoutSnorm16),
+					 "fail to create mLayoutSnorm16,  cant use gpu voxelizer");
 		CHECK_RESULT(device->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), NULL, &mVertexShader), 
 					 "fail to create vertex shader,  cant use gpu voxelizer");
 		blob->Release();
@@ -57,7 +66,7 @@ void DefaultEffect::init(ID3D11Device* device)
 void DefaultEffect::prepare(ID3D11DeviceContext* context)
 {
 	context->VSSetShader(mVertexShader, NULL, 0);
-	context->IASetInputLayout(mLayout);
+	context->IASetInputLayout(mPositionFormat == PF_SNORM16 ? mLayoutSnorm16 : mLayout);
 	context->PSSetShader(mPixelShader, NULL, 0);
 	context->VSSetConstantBuffers(0, 1, &mConstant);
 	context->PSSetConstantBuffers(0, 1, &mConstant);
@@ -76,62 +85,154 @@ void DefaultEffect::clean()
 	mConstant->Release();
 	mVertexShader->Release();
 	mLayout->Release();
+	mLayoutSnorm16->Release();
 	mPixelShader->Release();
 }
 
+void DefaultEffect::setPositionFormat(PositionFormat format)
+{
+	mPositionFormat = format;
+}
+
 void VoxelResource::setVertex(const void* vertices, size_t vertexCount, size_t vertexStride, size_t posoffset )
 {
+	mSource = nullptr;
 	mVertexStride = vertexStride;
 	mVertexCount = vertexCount;
 	mPositionOffset = posoffset;
 
 	//calculate the max size
+	mAABB = computeBounds(vertices, vertexCount, vertexStride, posoffset);
+	mNeedCalSize = false;
+	mPositionFormat = PF_FLOAT3;
+
+	mVertexView = nullptr;
+	mVertexBuffer.release();
+	CHECK_RESULT(Helper::createBuffer(&mVertexBuffer, mDevice, D3D11_BIND_VERTEX_BUFFER, vertexCount * vertexStride, vertices),
+				 "fail to create vertex buffer,  cant use gpu voxelizer");
+
+
+}
+
+void VoxelResource::setVertexQuantized(const short* positions, size_t vertexCount, size_t vertexStride, const Vector3& scale, const Vector3& offset)
+{
+	mSource = nullptr;
+	mVertexStride = vertexStride;
+	mVertexCount = vertexCount;
+	mPositionOffset = 0;
+	mPositionFormat = PF_SNORM16;
+	mDecodeScale = scale;
+	mDecodeOffset = offset;
+
+	//bounds of the quantized values, then decoded
 	mAABB.setNull();
-	size_t buffersize = vertexCount * vertexStride;
+	if (vertexCount != 0)
 	{
-		const char* begin = (const char*)vertices;
-		const char* end = begin + buffersize;
-		for (; begin != end; begin += vertexStride)
+		short qmin[3] = { 32767, 32767, 32767 };
+		short qmax[3] = { -32768, -32768, -32768 };
+		const char* begin = (const char*)positions;
+		for (size_t i = 0; i < vertexCount; ++i, begin += vertexStride)
 		{
-			Vector3 v = (*(const Vector3*)begin) ;
-			mAABB.merge(v);
+			const short* q = (const short*)begin;
+			for (int j = 0; j < 3; ++j)
+			{
+				qmin[j] = std::min(qmin[j], q[j]);
+				qmax[j] = std::max(qmax[j], q[j]);
+			}
 		}
-	}
 
+		auto decode = [&scale, &offset](const short* q)
+		{
+			return Vector3(std::max(q[0] / 32767.0f, -1.0f) * scale.x + offset.x,
+						   std::max(q[1] / 32767.0f, -1.0f) * scale.y + offset.y,
+						   std::max(q[2] / 32767.0f, -1.0f) * scale.z + offset.z);
+		};
+		//a negative scale swaps the corners
+		mAABB.merge(decode(qmin));
+		mAABB.merge(decode(qmax));
+	}
 	mNeedCalSize = false;
 
+	mVertexView = nullptr;
 	mVertexBuffer.release();
-	CHECK_RESULT(Helper::createBuffer(&mVertexBuffer, mDevice, D3D11_BIND_VERTEX_BUFFER, vertexCount * vertexStride, vertices),
+	CHECK_RESULT(Helper::createBuffer(&mVertexBuffer, mDevice, D3D11_BIND_VERTEX_BUFFER, vertexCount * vertexStride, positions),
 				 "fail to create vertex buffer,  cant use gpu voxelizer");
+}
 
+void VoxelResource::setVertexView(const void* vertices, size_t vertexCount, size_t vertexStride, size_t posoffset, size_t texcoordOffset)
+{
+	//2 floats of texcoord have to fit in the vertex, or the last one reads past the batch
+	if (texcoordOffset != NO_TEXCOORD && texcoordOffset + sizeof(float) * 2 > vertexStride)
+		EXCEPT("texcoord outside of the vertex");
 
+	mSource = nullptr;
+	mVertexStride = vertexStride;
+	mVertexCount = vertexCount;
+	mPositionOffset = posoffset;
+	mPositionFormat = PF_FLOAT3;
+	mTexcoordOffset = texcoordOffset;
+
+	//bounds are computed while voxelizing, unless setBounds is called
+	mNeedCalSize = true;
+
+	mVertexBuffer.release();
+	mTexcoordBuffer.release();
+	mVertexView = vertices;
 }
 
 void VoxelResource::setVertexFromVoxelResource(VoxelResource* res)
 {
-	mAABB = res->mAABB;
+	res = res->getGeometry();
+
+	if (res->mVertexView != nullptr)
+	{
+		setVertexView(res->mVertexView, res->mVertexCount, res->mVertexStride, res->mPositionOffset, res->mTexcoordOffset);
+		return;
+	}
 
 	setVertex(res->mVertexBuffer, res->mVertexCount, res->mVertexStride, res->mPositionOffset);
+
+	//the buffer keeps the format of the source, and its bounds as long as the source trusts them
+	mPositionFormat = res->mPositionFormat;
+	mDecodeScale = res->mDecodeScale;
+	mDecodeOffset = res->mDecodeOffset;
+	mAABB = res->mAABB;
+	mNeedCalSize = res->mNeedCalSize;
 }
 
 void VoxelResource::setVertex(ID3D11Buffer* vertexBuffer, size_t vertexCount, size_t vertexStride, size_t posoffset )
 {
+	mSource = nullptr;
 	mVertexStride = vertexStride;
 	mVertexCount = vertexCount;
 	mPositionOffset = posoffset;
 
+	mPositionFormat = PF_FLOAT3;
+
 	vertexBuffer->AddRef();
+	mVertexView = nullptr;
 	mVertexBuffer.release();
 	mVertexBuffer = vertexBuffer;
 
 	mNeedCalSize = true;
 }
 
+void VoxelResource::setTexcoord(const void* texcoords, size_t vertexCount, size_t texcoordStride)
+{
+	mTexcoordStride = texcoordStride;
+
+	mTexcoordBuffer.release();
+	if (texcoords != 0 && vertexCount != 0 && texcoordStride != 0)
+		CHECK_RESULT(Helper::createBuffer(&mTexcoordBuffer, mDevice, D3D11_BIND_VERTEX_BUFFER, vertexCount * texcoordStride, texcoords),
+				 "fail to create texcoord buffer,  cant use gpu voxelizer");
+}
+
 void VoxelResource::setIndex(const void* indexes, size_t indexCount, size_t indexStride)
 {
 	mIndexCount = indexCount;
 	mIndexStride = indexStride;
 
+	mIndexView = nullptr;
 	mIndexBuffer.release();
 	if (indexes != 0 && indexCount != 0 && indexStride != 0)
 		CHECK_RESULT(Helper::createBuffer(&mIndexBuffer, mDevice, D3D11_BIND_INDEX_BUFFER, indexCount * indexStride, indexes),
@@ -144,10 +245,29 @@ void VoxelResource::setIndex(ID3D11Buffer* indexBuffer, size_t indexCount, size_
 	mIndexStride = indexStride;
 
 	indexBuffer->AddRef();
+	mIndexView = nullptr;
 	mIndexBuffer.release();
 	mIndexBuffer = indexBuffer;
 }
 
+void VoxelResource::setIndexView(const void* indexes, size_t indexCount, size_t indexStride)
+{
+	mIndexCount = indexCount;
+	mIndexStride = indexStride;
+
+	mIndexBuffer.release();
+	mIndexView = (indexes != 0 && indexCount != 0) ? indexes : nullptr;
+}
+
+void VoxelResource::removeIndexes()
+{
+	mIndexCount = 0;
+	mIndexStride = 0;
+
+	mIndexBuffer.release();
+	mIndexView = nullptr;
+}
+
 VoxelResource::VoxelResource(ID3D11Device* device)
 	:mDevice(device)
 {
@@ -166,54 +286,83 @@ void VoxelResource::setEffect(Effect* effect)
 
 
 
-void VoxelResource::prepare(ID3D11DeviceContext* context)
+void VoxelResource::setBounds(const AABB& aabb)
 {
-	if (!mNeedCalSize)
-		return;
+	mAABB = aabb;
+	mNeedCalSize = false;
+}
 
-	if (mVertexBuffer == nullptr)
-		return;
+void VoxelResource::setWorld(const XMMATRIX& world)
+{
+	XMStoreFloat4x4(&mWorld, world);
+	mHasWorld = true;
+}
 
+void VoxelResource::removeWorld()
+{
+	mHasWorld = false;
+}
 
-	mAABB.setNull();
-	D3D11_BUFFER_DESC desc;
-	mVertexBuffer->GetDesc(&desc);
+AABB VoxelResource::getWorldBounds() const
+{
+	const AABB& local = getGeometry()->mAABB;
+	if (!mHasWorld || !local.isValid())
+		return local;
 
-	auto calSize = [this](ID3D11DeviceContext* context, ID3D11Buffer* buffer, size_t count , size_t stride, size_t offset)
-	{
-		D3D11_MAPPED_SUBRESOURCE mr;
-		context->Map(buffer, 0, D3D11_MAP_READ, 0, &mr);
+	//center and half extents through the matrix, the extents by the absolute rows.
+	//gives the same box as transforming all 8 corners
+	Vector3 c = local.getCenter();
+	Vector3 e = local.getSize() * 0.5f;
+	XMMATRIX m = XMLoadFloat4x4(&mWorld);
 
-		size_t buffersize = count * stride;
-		{
-			const char* begin = (const char*)mr.pData;
-			const char* end = begin + buffersize;
-			for (; begin != end; begin += stride)
-			{
-				Vector3 v = (*(const Vector3*)(begin + offset));
-				mAABB.merge(v);
-			}
-		}
+	XMVECTOR center = XMVector3TransformCoord(XMVectorSet(c.x, c.y, c.z, 1.0f), m);
+	XMVECTOR extent = XMVectorMultiply(XMVectorReplicate(e.x), XMVectorAbs(m.r[0]));
+	extent = XMVectorMultiplyAdd(XMVectorReplicate(e.y), XMVectorAbs(m.r[1]), extent);
+	extent = XMVectorMultiplyAdd(XMVectorReplicate(e.z), XMVectorAbs(m.r[2]), extent);
 
-		context->Unmap(buffer, 0);
-	};
+	XMFLOAT3 min, max;
+	XMStoreFloat3(&min, XMVectorSubtract(center, extent));
+	XMStoreFloat3(&max, XMVectorAdd(center, extent));
 
-	if ((desc.CPUAccessFlags & D3D11_CPU_ACCESS_READ) != 0)
-	{
-		calSize(context, mVertexBuffer, mVertexCount, mVertexStride, mPositionOffset);
-	}
-	else
+	AABB aabb;
+	aabb.setExtents(Vector3(min.x, min.y, min.z), Vector3(max.x, max.y, max.z));
+	return aabb;
+}
+
+const char* VoxelResource::mapVertices(ID3D11DeviceContext* context)
+{
+	if (mVertexView != nullptr)
+		return (const char*)mVertexView;
+
+	D3D11_BUFFER_DESC desc;
+	mVertexBuffer->GetDesc(&desc);
+
+	ID3D11Buffer* buffer = mVertexBuffer;
+	if ((desc.CPUAccessFlags & D3D11_CPU_ACCESS_READ) == 0)
 	{
 		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
 		desc.BindFlags = 0;
 		desc.Usage = D3D11_USAGE_STAGING;
-		ID3D11Buffer* tmp = 0;
-		CHECK_RESULT(mDevice->CreateBuffer(&desc, nullptr, &tmp),
+		desc.MiscFlags = 0;
+		CHECK_RESULT(mDevice->CreateBuffer(&desc, nullptr, &mStaging),
 					 "fail to create temp buffer for reading.");
-		context->CopyResource(tmp, mVertexBuffer);
-		calSize(context, tmp, mVertexCount, mVertexStride, mPositionOffset);
-		tmp->Release();
+		context->CopyResource(mStaging, mVertexBuffer);
+		buffer = mStaging;
 	}
+
+	D3D11_MAPPED_SUBRESOURCE mr;
+	CHECK_RESULT(context->Map(buffer, 0, D3D11_MAP_READ, 0, &mr),
+				 "fail to map vertex buffer for reading.");
+	mMapped = buffer;
+	return (const char*)mr.pData;
+}
+
+void VoxelResource::unmapVertices(ID3D11DeviceContext* context)
+{
+	if (mMapped != nullptr)
+		context->Unmap(mMapped, 0);
+	mMapped = nullptr;
+	mStaging.release();
 }
 
 VoxelOutput::VoxelOutput(ID3D11Device* device, ID3D11DeviceContext* context)
@@ -270,7 +419,7 @@ void VoxelOutput::exportData(VoxelData& data, size_t slot)
 	mContext->Map(debug, 0, D3D11_MAP_READ, 0, &mr);
 
 	int stride = ret->second.para.elementSize * mWidth;
-	data.datas.reserve(stride * mHeight * mDepth);
+	data.datas.resize(stride * mHeight * mDepth);
 	char* begin = data.datas.data();
 	for (size_t z = 0; z < mDepth; ++z)
 	{
@@ -371,20 +520,125 @@ void Voxelizer::setScale(float v)
 	mScale = v;
 }
 
+void Voxelizer::setRegion(const AABB& region)
+{
+	if (!region.isValid())
+		EXCEPT("invalid region");
+
+	mRegion = region;
+}
+
+void Voxelizer::removeRegion()
+{
+	mRegion.setNull();
+}
+
+void Voxelizer::setGrid(const Vector3& origin, float voxelSize, int width, int height, int depth)
+{
+	if (voxelSize <= 0 || width <= 0 || height <= 0 || depth <= 0)
+		EXCEPT("invalid grid");
+
+	mHasGrid = true;
+	mGridOrigin = origin;
+	mGridVoxelSize = voxelSize;
+	mGridSize[0] = width;
+	mGridSize[1] = height;
+	mGridSize[2] = depth;
+}
+
+void Voxelizer::removeGrid()
+{
+	mHasGrid = false;
+}
+
+float Voxelizer::getGridScale()const
+{
+	return mHasGrid ? 1.0f / mGridVoxelSize : mScale / mVoxelSize;
+}
+
 Vector3 Voxelizer::prepare(VoxelOutput* output, size_t count, VoxelResource** res)
 {
 	if (res == nullptr)
 		return Vector3::ZERO;
 
+	//the fixed grid does not depend on the bounds, they are only needed to leave out resources outside of a region
+	if (mHasGrid && !mRegion.isValid())
+		return prepareGrid(output, AABB());
+
+	//buffers are mapped one after another on the context, the scans then run in parallel
+	std::vector<VoxelResource*> pending;
+	std::vector<const char*> vertices;
+	try
+	{
+		//instances share the bounds of their source, which is scanned once
+		std::set<VoxelResource*> seen;
+		for (size_t i = 0; i < count; ++i)
+		{
+			VoxelResource* r = res[i]->getGeometry();
+			if (!r->mNeedCalSize || (r->mVertexBuffer == nullptr && r->mVertexView == nullptr))
+				continue;
+			if (!seen.insert(r).second)
+				continue;
+			pending.push_back(r);
+			vertices.push_back(r->mapVertices(mContext));
+		}
+
+		auto scan = [&](size_t i)
+		{
+			VoxelResource* r = pending[i];
+			r->mAABB = computeBounds(vertices[i], r->mVertexCount, r->mVertexStride, r->mPositionOffset);
+		};
+
+		//computeBounds already splits large arrays over threads, nesting that would start threads^2 workers
+		bool large = false;
+		for (auto r : pending)
+			large = large || r->mVertexCount > BOUNDS_CHUNK_VERTICES;
+
+		if (large)
+		{
+			for (size_t i = 0; i < pending.size(); ++i)
+				scan(i);
+		}
+		else
+			parallelFor(0, pending.size(), scan);
+	}
+	catch (...)
+	{
+		for (auto r : pending)
+			r->unmapVertices(mContext);
+		throw;
+	}
+
+	for (auto r : pending)
+	{
+		r->unmapVertices(mContext);
+		//gpu buffers may be rewritten by the caller, they are read again next time
+		r->mNeedCalSize = r->mVertexView == nullptr;
+	}
+
+	if (mHasGrid || mRegion.isValid())
+		return prepareGrid(output, mRegion);
+
 	AABB aabb;
 	for (size_t i = 0; i < count; ++i)
+		aabb.merge(res[i]->getWorldBounds());
+
+	return prepareGrid(output, aabb);
+}
+
+Vector3 Voxelizer::prepareGrid(VoxelOutput* output, const AABB& aabb)
+{
+	if (mHasGrid)
 	{
-		res[i]->prepare(mContext);
-		aabb.merge(res[i]->mAABB);
+		//whole voxels, the views cover exactly the grid
+		Vector3 range(mGridSize[0] * mGridVoxelSize, mGridSize[1] * mGridVoxelSize, mGridSize[2] * mGridVoxelSize);
+		mCenter = Vector3(mGridOrigin.x + range.x * 0.5f, mGridOrigin.y + range.y * 0.5f, mGridOrigin.z + range.z * 0.5f);
+		mTranslation = XMMatrixTranspose(XMMatrixTranslation(-mCenter.x, -mCenter.y, -mCenter.z));
+		output->prepare(mGridSize[0], mGridSize[1], mGridSize[2]);
+		return range;
 	}
 
-
-	float scale = mScale / mVoxelSize;
+	float scale = getGridScale();
 	Vector3 osize = aabb.getSize();
 	//osize += Vector3::UNIT_SCALE;
 
@@ -393,6 +647,7 @@ Vector3 Voxelizer::prepare(VoxelOutput* output, size_t count, VoxelResource** re
 	Vector3 center = aabb.getCenter();
 
 
+	mCenter = center;
 	mTranslation = XMMatrixTranspose(XMMatrixTranslation(-center.x, -center.y, -center.z));
 	
 	float ex = 2 / scale;
@@ -407,17 +662,10 @@ Vector3 Voxelizer::prepare(VoxelOutput* output, size_t count, VoxelResource** re
 	return osize ;
 }
 
-
-void Voxelizer::voxelize(VoxelOutput* output, size_t count, VoxelResource** res)
+void Voxelizer::prepareRasterizer()
 {
-	Vector3 range;
-	if ((range = prepare(output, count, res)) == Vector3::ZERO)
-	{
-		EXCEPT(" cant use gpu voxelizer");
-	}
-
 	//no need to cull
-	Interface<ID3D11RasterizerState> rasterizerState;
+	if (mRasterizerState.isNull())
 	{
 		D3D11_RASTERIZER_DESC desc;
 		desc.FillMode = D3D11_FILL_SOLID;
@@ -431,35 +679,210 @@ void Voxelizer::voxelize(VoxelOutput* output, size_t count, VoxelResource** res)
 		desc.MultisampleEnable = false;
 		desc.AntialiasedLineEnable = false;
 
-		CHECK_RESULT(mDevice->CreateRasterizerState(&desc, &rasterizerState),
+		CHECK_RESULT(mDevice->CreateRasterizerState(&desc, &mRasterizerState),
 					 "fail to create rasterizer state,  cant use gpu voxelizer");
-		mContext->RSSetState(rasterizerState);
 	}
+	mContext->RSSetState(mRasterizerState);
+}
+
+
+void Voxelizer::voxelize(VoxelOutput* output, size_t count, VoxelResource** res)
+{
+	Vector3 range;
+	if ((range = prepare(output, count, res)) == Vector3::ZERO)
+	{
+		EXCEPT(" cant use gpu voxelizer");
+	}
+
+	prepareRasterizer();
 
 	for (size_t i = 0; i < count; ++i)
 	{
+		//resources outside of the region are skipped. without a fixed grid the rasterizer also clips the rest to it
+		if (mRegion.isValid() && !mRegion.intersects(res[i]->getWorldBounds()))
+			continue;
 		voxelizeImpl(res[i], range);
 	}
 
 }
 
+void Voxelizer::beginVoxelize(VoxelOutput* output, const AABB& bounds)
+{
+	if (!bounds.isValid() && !mRegion.isValid() && !mHasGrid)
+		EXCEPT("invalid bounds, cant use gpu voxelizer");
+
+	mStreamRange = prepareGrid(output, mRegion.isValid() ? mRegion : bounds);
+	prepareRasterizer();
+	mStreaming = true;
+}
+
+void Voxelizer::voxelizeBatch(const void* vertices, size_t vertexCount, size_t vertexStride, Effect* effect, size_t texcoordOffset)
+{
+	if (!mStreaming)
+		EXCEPT("voxelizeBatch without beginVoxelize");
+	if (texcoordOffset != NO_TEXCOORD && texcoordOffset + sizeof(float) * 2 > vertexStride)
+		EXCEPT("texcoord outside of the vertex");
+	if (vertexCount == 0)
+		return;
+
+	char* dest = mapStreamBuffer(vertexCount * vertexStride);
+	if (!mHasGrid || !mRegion.isValid())
+	{
+		memcpy(dest, vertices, vertexCount * vertexStride);
+		drawStreamBuffer(effect, mStreamRange, vertexCount, vertexStride, 0, texcoordOffset, mTranslation);
+		return;
+	}
+
+	//the fixed grid is not clipped to the region, so the triangles outside of it are left out here
+	const char* src = (const char*)vertices;
+	const size_t triangleSize = vertexStride * 3;
+	size_t count = 0;
+	for (size_t i = 0; i + 3 <= vertexCount; i += 3, src += triangleSize)
+	{
+		AABB bounds;
+		for (int j = 0; j < 3; ++j)
+		{
+			Vector3 position;
+			memcpy(&position, src + j * vertexStride, sizeof(float) * 3);
+			bounds.merge(position);
+		}
+		if (!mRegion.intersects(bounds))
+			continue;
+
+		memcpy(dest + count * vertexStride, src, triangleSize);
+		count += 3;
+	}
+
+	if (count == 0)
+	{
+		mContext->Unmap(mStreamBuffer, 0);
+		return;
+	}
+	drawStreamBuffer(effect, mStreamRange, count, vertexStride, 0, texcoordOffset, mTranslation);
+}
+
+char* Voxelizer::mapStreamBuffer(size_t size)
+{
+	//the stream buffer only grows, so a run of equal sized batches reuses one allocation
+	if (size > mStreamBufferSize)
+	{
+		mStreamBuffer.release();
+		mStreamBufferSize = 0;
+		CHECK_RESULT(Helper::createDynamicBuffer(&mStreamBuffer, mDevice, D3D11_BIND_VERTEX_BUFFER, size),
+					 "fail to create stream buffer, cant use gpu voxelizer");
+		mStreamBufferSize = size;
+	}
+
+	D3D11_MAPPED_SUBRESOURCE mr;
+	CHECK_RESULT(mContext->Map(mStreamBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &mr),
+				 "fail to map stream buffer, cant use gpu voxelizer");
+	return (char*)mr.pData;
+}
+
+void Voxelizer::drawStreamBuffer(Effect* effect, const Vector3& range, size_t vertexCount, size_t vertexStride, size_t posoffset, size_t texcoordOffset, const XMMATRIX& world)
+{
+	mContext->Unmap(mStreamBuffer, 0);
+
+	//without texcoords slot 1 is unbound as for resources without setTexcoord
+	const bool texcoord = texcoordOffset != NO_TEXCOORD;
+	ID3D11Buffer* buffers[] = { mStreamBuffer, texcoord ? (ID3D11Buffer*)mStreamBuffer : NULL };
+	UINT strides[] = { (UINT)vertexStride, texcoord ? (UINT)vertexStride : 0 };
+	UINT offsets[] = { (UINT)posoffset, texcoord ? (UINT)texcoordOffset : 0 };
+	mContext->IASetVertexBuffers(0, 2, buffers, strides, offsets);
+	mContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+
+	effect->setPositionFormat(PF_FLOAT3);
+	effect->prepare(mContext);
+	drawViews(effect, range, vertexCount, false, world);
+}
+
+void Voxelizer::voxelizeView(VoxelResource* res, Effect* effect, const XMMATRIX& world, const Vector3& range)
+{
+	const char* vertices = (const char*)res->mVertexView;
+	const size_t stride = res->mVertexStride;
+	const size_t batch = STREAM_BATCH_TRIANGLES * 3;
+
+	if (res->mIndexView == nullptr)
+	{
+		size_t count = res->mVertexCount - res->mVertexCount % 3;
+		for (size_t first = 0; first < count; first += batch)
+		{
+			size_t n = std::min(batch, count - first);
+			memcpy(mapStreamBuffer(n * stride), vertices + first * stride, n * stride);
+			drawStreamBuffer(effect, range, n, stride, res->mPositionOffset, res->mTexcoordOffset, world);
+		}
+		return;
+	}
+
+	if (res->mIndexStride != 2 && res->mIndexStride != 4)
+		EXCEPT("unknown index format");
+
+	//indexed views are expanded to triangle lists one batch at a time, straight into the mapped buffer
+	const unsigned short* index16 = (const unsigned short*)res->mIndexView;
+	const unsigned int* index32 = (const unsigned int*)res->mIndexView;
+	size_t count = res->mIndexCount - res->mIndexCount % 3;
+	for (size_t first = 0; first < count; first += batch)
+	{
+		size_t n = std::min(batch, count - first);
+		char* dest = mapStreamBuffer(n * stride);
+		for (size_t i = 0; i < n; ++i)
+		{
+			size_t index = res->mIndexStride == 2 ? index16[first + i] : index32[first + i];
+			if (index >= res->mVertexCount)
+			{
+				mContext->Unmap(mStreamBuffer, 0);
+				EXCEPT("index out of range");
+			}
+			memcpy(dest + i * stride, vertices + index * stride, stride);
+		}
+		drawStreamBuffer(effect, range, n, stride, res->mPositionOffset, res->mTexcoordOffset, world);
+	}
+}
+
+void Voxelizer::endVoxelize()
+{
+	//the output of a stream that never began is not prepared
+	if (!mStreaming)
+		EXCEPT("endVoxelize without beginVoxelize");
+	mStreaming = false;
+
+	ID3D11Buffer* empty[] = { NULL, NULL };
+	UINT strides[] = { 0, 0 };
+	UINT offsets[] = { 0, 0 };
+	mContext->IASetVertexBuffers(0, 2, empty, strides, offsets);
+}
+
 void Voxelizer::voxelizeImpl(VoxelResource* res, const Vector3& range)
 {
+	//an instance draws the geometry of its source with its own effect and world
+	VoxelResource* geo = res->getGeometry();
+
+	//views are streamed from cpu memory, they cant be mixed with gpu buffers
+	if (geo->mVertexView != nullptr)
+	{
+		if (geo->mIndexBuffer != nullptr)
+			EXCEPT("index buffer cant be used with a vertex view");
+		voxelizeView(geo, res->mEffect, getWorld(res), range);
+		return;
+	}
+	if (geo->mIndexView != nullptr)
+		EXCEPT("index view cant be used with a vertex buffer");
 
 
-	UINT stride = res->mVertexStride;
-	UINT offset = 0;
-	mContext->IASetVertexBuffers(0, 1, &res->mVertexBuffer, &stride, &offset);
+	//slot 1 is always set, so a resource without texcoords does not read the previous one's
+	ID3D11Buffer* buffers[] = { geo->mVertexBuffer, geo->mTexcoordBuffer };
+	UINT strides[] = { (UINT)geo->mVertexStride, (UINT)geo->mTexcoordStride };
+	UINT offsets[] = { 0, 0 };
+	mContext->IASetVertexBuffers(0, 2, buffers, strides, offsets);
 	mContext->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 
-	int start = 0;
-	int count = res->mVertexCount;
+	int count = geo->mVertexCount;
 
-	bool useIndex = res->mIndexBuffer != nullptr;
+	bool useIndex = geo->mIndexBuffer != nullptr;
 	if (useIndex)
 	{
 		DXGI_FORMAT format = DXGI_FORMAT_R16_UINT;
-		switch (res->mIndexStride)
+		switch (geo->mIndexStride)
 		{
 		case 2: format = DXGI_FORMAT_R16_UINT; break;
 		case 4: format = DXGI_FORMAT_R32_UINT; break;
@@ -467,14 +890,40 @@ void Voxelizer::voxelizeImpl(VoxelResource* res, const Vector3& range)
 			EXCEPT("unknown index format");
 			break;
 		}
-		mContext->IASetIndexBuffer(res->mIndexBuffer, format, 0);
+		mContext->IASetIndexBuffer(geo->mIndexBuffer, format, 0);
 
-		count = res->mIndexCount;
+		count = geo->mIndexCount;
 	}
 
+	res->mEffect->setPositionFormat(geo->mPositionFormat);
 	res->mEffect->prepare(mContext);
 
+	drawViews(res->mEffect, range, count, useIndex, getWorld(res));
+}
+
+XMMATRIX Voxelizer::getWorld(VoxelResource* res) const
+{
+	const VoxelResource* geo = res->getGeometry();
+	if (geo->mPositionFormat != PF_SNORM16 && !res->mHasWorld)
+		return mTranslation;
+
+	//the snorm decode and the instance transform are folded into the world matrix,
+	//so the vertex shader transforms every vertex once
+	XMMATRIX world = XMMatrixIdentity();
+	if (geo->mPositionFormat == PF_SNORM16)
+	{
+		const Vector3& s = geo->mDecodeScale;
+		const Vector3& o = geo->mDecodeOffset;
+		world = XMMatrixScaling(s.x, s.y, s.z) * XMMatrixTranslation(o.x, o.y, o.z);
+	}
+	if (res->mHasWorld)
+		world = world * XMLoadFloat4x4(&res->mWorld);
+
+	return XMMatrixTranspose(world * XMMatrixTranslation(-mCenter.x, -mCenter.y, -mCenter.z));
+}
 
+void Voxelizer::drawViews(Effect* effect, const Vector3& range, size_t count, bool useIndex, const XMMATRIX& world)
+{
 	struct ViewPara
 	{
 		Vector3 eye;
@@ -485,12 +934,12 @@ void Voxelizer::voxelizeImpl(VoxelResource* res, const Vector3& range)
 		float depth;
 	};
 
-	const float scale = mScale / mVoxelSize;
+	const float scale = getGridScale();
 
 	EffectParameter parameters;
 	parameters.device = mDevice;
 	parameters.context = mContext;
-	parameters.world = mTranslation;
+	parameters.world = world;
 	parameters.proj = mProjection;
 	parameters.width = range.x * scale;
 	parameters.height = range.y * scale;
@@ -532,12 +981,12 @@ void Voxelizer::voxelizeImpl(VoxelResource* res, const Vector3& range)
 		vp.TopLeftY = 0;
 		mContext->RSSetViewports(1, &vp);
 
-		res->mEffect->update(parameters);
+		effect->update(parameters);
 
 		if (useIndex)
-			mContext->DrawIndexed(count, start, 0);
+			mContext->DrawIndexed(count, 0, 0);
 		else
-			mContext->Draw(count, start);
+			mContext->Draw(count, 0);
 
 	}
 
@@ -565,10 +1014,30 @@ void Voxelizer::removeEffect(Effect* effect)
 VoxelResource* Voxelizer::createResource()
 {
 	VoxelResource* vr = new VoxelResource(mDevice);
+	std::lock_guard<std::mutex> lock(mResourceLock);
 	mResources.push_back(vr);
 	return vr;
 }
 
+VoxelResource* Voxelizer::createInstance(VoxelResource* source)
+{
+	VoxelResource* vr = createResource();
+	vr->mSource = source->getGeometry();
+	vr->mEffect = source->mEffect;
+	return vr;
+}
+
+void Voxelizer::createResources(size_t count, VoxelResource** res)
+{
+	std::lock_guard<std::mutex> lock(mResourceLock);
+	mResources.reserve(mResources.size() + count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		res[i] = new VoxelResource(mDevice);
+		mResources.push_back(res[i]);
+	}
+}
+
 VoxelOutput* Voxelizer::createOutput()
 {
 	VoxelOutput* vo = new VoxelOutput(mDevice, mContext);
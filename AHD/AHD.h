@@ -9,6 +9,7 @@
 #include "AHDUtils.h"
 #include <set>
 #include <map>
+#include <mutex>
 
 namespace AHD
 {
@@ -53,6 +54,15 @@ namespace AHD
 		size_t viewport;// from 0 to 2 
 	};
 
+	enum PositionFormat
+	{
+		PF_FLOAT3,//DXGI_FORMAT_R32G32B32_FLOAT
+		PF_SNORM16,//DXGI_FORMAT_R16G16B16A16_SNORM, w is ignored. the decode is part of the world matrix
+	};
+
+	//texcoord offset of vertices without texcoords, slot 1 is then left unbound
+	const size_t NO_TEXCOORD = ~(size_t)0;
+
 	class Effect
 	{
 	public :
@@ -61,6 +71,9 @@ namespace AHD
 		virtual void update(EffectParameter& paras) = 0;
 		virtual void clean() = 0;
 
+		//called before prepare with the position format of the resource that is drawn next.
+		//effects that read other formats than PF_FLOAT3 have to override it
+		virtual void setPositionFormat(PositionFormat format);
 	};
 
 	class DefaultEffect :public Effect
@@ -70,11 +83,14 @@ namespace AHD
 		void prepare(ID3D11DeviceContext* context);
 		void update(EffectParameter& paras);
 		void clean();
+		void setPositionFormat(PositionFormat format);
 
 		ID3D11VertexShader* mVertexShader;
 		ID3D11PixelShader* mPixelShader;
 		ID3D11InputLayout* mLayout;
+		ID3D11InputLayout* mLayoutSnorm16;
 		ID3D11Buffer* mConstant;
+		PositionFormat mPositionFormat = PF_FLOAT3;
 
 	public :
 		static const DXGI_FORMAT OUTPUT_FORMAT = DXGI_FORMAT_R8G8B8A8_UNORM;
@@ -91,45 +107,79 @@ namespace AHD
 		void setVertex(ID3D11Buffer* vertexBuffer, size_t vertexCount, size_t vertexStride, size_t posoffset = 0);
 		void setVertexFromVoxelResource(VoxelResource* res);
 
+		//positions quantized to 16 bit, 4 shorts per vertex with w unused (see quantizePositions).
+		//they are decoded as short / 32767 * scale + offset by the world matrix while voxelizing
+		void setVertexQuantized(const short* positions, size_t vertexCount, size_t vertexStride, const Vector3& scale, const Vector3& offset);
+
+		//texcoords in their own array, bound to vertex buffer slot 1 next to the positions in slot 0.
+		//together with setVertex(positions, count, sizeof(float) * 3) this takes tinyobj::mesh_t arrays as they are.
+		//pass null to remove them
+		void setTexcoord(const void* texcoords, size_t vertexCount, size_t texcoordStride = sizeof(float) * 2);
+
 		
 		void setIndex(const void* indexes, size_t indexCount, size_t indexStride);
 		void setIndex(ID3D11Buffer* indexBuffer, size_t indexCount, size_t indexStride);
+
+		//borrowed views: nothing is copied or uploaded here, the voxelizer reads the caller's memory
+		//in batches while voxelizing, indexed views are expanded batch by batch.
+		//the memory (a mapped file is fine) must stay valid and unchanged until the last voxelize()
+		//using this resource has returned, or until another setVertex/setIndex call replaces the view.
+		//the position is read at posoffset and slot 1 at texcoordOffset of each vertex, NO_TEXCOORD for none
+		void setVertexView(const void* vertices, size_t vertexCount, size_t vertexStride, size_t posoffset = 0, size_t texcoordOffset = NO_TEXCOORD);
+		void setIndexView(const void* indexes, size_t indexCount, size_t indexStride);
 		void removeIndexes();
 
 		~VoxelResource();
 
 		void setEffect(Effect* effect);
+
+		//known bounds of the current vertices. setVertex with cpu data always scans them,
+		//for vertex buffers and views this saves the scan (and the gpu readback) in voxelize
+		void setBounds(const AABB& aabb);
+
+		//object to world transform (row vectors, as XMMatrix* build them), applied while voxelizing
+		void setWorld(const XMMATRIX& world);
+		void removeWorld();
 	private:
 		VoxelResource(ID3D11Device* device);
-		void prepare(ID3D11DeviceContext* context);
+		VoxelResource* getGeometry(){ return mSource != nullptr ? mSource : this; }
+		const VoxelResource* getGeometry()const{ return mSource != nullptr ? mSource : this; }
+		AABB getWorldBounds()const;
+		const char* mapVertices(ID3D11DeviceContext* context);
+		void unmapVertices(ID3D11DeviceContext* context);
 
 	private:
 
 		Interface<ID3D11Buffer> mVertexBuffer = nullptr;
 		Interface<ID3D11Buffer> mIndexBuffer = nullptr;
+		Interface<ID3D11Buffer> mTexcoordBuffer = nullptr;
+		size_t mTexcoordStride = 0;
+		const void* mVertexView = nullptr;
+		const void* mIndexView = nullptr;
+		size_t mTexcoordOffset = 0;
 		size_t mVertexCount = 0;
 		size_t mVertexStride = 0;
 		size_t mPositionOffset = 0;
+		PositionFormat mPositionFormat = PF_FLOAT3;
+		Vector3 mDecodeScale = Vector3::UNIT_SCALE;
+		Vector3 mDecodeOffset = Vector3::ZERO;
 		size_t mIndexCount = 0;
 		size_t mIndexStride = 0;
 
 		ID3D11Device* mDevice;
 
+		Interface<ID3D11Buffer> mStaging = nullptr;
+		ID3D11Buffer* mMapped = nullptr;
+
 		AABB mAABB;
 		bool mNeedCalSize = true;
+		VoxelResource* mSource = nullptr;
+		//XMFLOAT4X4, resources live on the heap where XMMATRIX would not be 16 byte aligned
+		XMFLOAT4X4 mWorld;
+		bool mHasWorld = false;
 		Effect* mEffect = nullptr;
 	};
 
-	struct VoxelData
-	{
-		std::vector<char> datas;
-		int width = 0;
-		int height = 0;
-		int depth = 0;
-
-	
-	};
-
 	class VoxelOutput
 	{
 	public:
@@ -178,19 +228,60 @@ namespace AHD
 
 		void setScale(float scale);
 		void setVoxelSize(float v);
+
+		//only the box region (world space) is voxelized: the grid covers the region instead of the bounds
+		//of all resources, triangles are clipped to it and resources outside of it are not drawn.
+		//streaming voxelizes the region instead of the bounds given to beginVoxelize.
+		//with a fixed grid (setGrid) the grid stays as it is, and the region only leaves out the resources and
+		//streamed triangles outside of it. triangles that reach into it are drawn whole
+		void setRegion(const AABB& region);
+		void removeRegion();
+
+		//a fixed grid of width x height x depth voxels of voxelSize world units, with its min corner at origin.
+		//grids with the same voxel size and origins whole voxels apart line up voxel for voxel.
+		//no bounds are computed or read back from gpu buffers, unless a region is set too. replaces the scale and voxel size
+		void setGrid(const Vector3& origin, float voxelSize, int width, int height, int depth);
+		void removeGrid();
 		
 
 		void voxelize(VoxelOutput* output, size_t resourceNum, VoxelResource** res);
 
+		//streaming mode: the grid is sized from bounds up front, then unindexed triangle lists
+		//are uploaded batch by batch through one dynamic buffer, so no VoxelResource holds the mesh.
+		//the position has to be at offset 0 of each vertex, slot 1 reads the same vertices at texcoordOffset
+		//or is left unbound with NO_TEXCOORD
+		void beginVoxelize(VoxelOutput* output, const AABB& bounds);
+		void voxelizeBatch(const void* vertices, size_t vertexCount, size_t vertexStride, Effect* effect, size_t texcoordOffset = NO_TEXCOORD);
+		void endVoxelize();
+
 		void addEffect(Effect* effect);
 		void removeEffect(Effect* effect);
 
+		//resources only create their own buffers, so different resources can be set up from different threads.
+		//a device passed in from outside must not be created with D3D11_CREATE_DEVICE_SINGLETHREADED for that
 		VoxelResource* createResource();
+		void createResources(size_t count, VoxelResource** res);
+
+		//an instance draws the vertexes and indexes of source, nothing is copied or uploaded again.
+		//it starts with the effect of source and gets its own world by setWorld.
+		//changes to the geometry of source show up in all of its instances, setVertex on an instance detaches it
+		VoxelResource* createInstance(VoxelResource* source);
 		VoxelOutput* createOutput();
 
 	private:
 		void voxelizeImpl(VoxelResource* res, const Vector3& range);
 		Vector3 prepare(VoxelOutput* output, size_t resourceNum, VoxelResource** res);
+		Vector3 prepareGrid(VoxelOutput* output, const AABB& aabb);
+		void prepareRasterizer();
+		//voxels per world unit
+		float getGridScale()const;
+		void drawViews(Effect* effect, const Vector3& range, size_t count, bool useIndex, const XMMATRIX& world);
+		XMMATRIX getWorld(VoxelResource* res) const;
+		void voxelizeView(VoxelResource* res, Effect* effect, const XMMATRIX& world, const Vector3& range);
+		char* mapStreamBuffer(size_t size);
+		void drawStreamBuffer(Effect* effect, const Vector3& range, size_t vertexCount, size_t vertexStride, size_t posoffset, size_t texcoordOffset, const XMMATRIX& world);
+
+		static const size_t STREAM_BATCH_TRIANGLES = 65536;
 		void cleanResource();
 
 	private:
@@ -199,14 +290,27 @@ namespace AHD
 		VoxelResource* mCurrentResource;
 		float mScale = 1.0f;
 		float mVoxelSize = 1.0f;
+		AABB mRegion;
+		bool mHasGrid = false;
+		Vector3 mGridOrigin;
+		float mGridVoxelSize = 1.0f;
+		int mGridSize[3];
 		XMMATRIX mTranslation;
+		Vector3 mCenter;
 		XMMATRIX mProjection;
 		std::set<Effect*> mEffects;
 
 		Interface<ID3D11Device> mDevice;
 		Interface<ID3D11DeviceContext>	 mContext;
+		Interface<ID3D11RasterizerState> mRasterizerState;
+
+		Interface<ID3D11Buffer> mStreamBuffer;
+		size_t mStreamBufferSize = 0;
+		Vector3 mStreamRange;
+		bool mStreaming = false;
 
 		std::vector<VoxelResource*> mResources;
+		std::mutex mResourceLock;
 		std::vector<VoxelOutput*> mOutputs;
 	};
 }
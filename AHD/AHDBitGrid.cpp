@@ -0,0 +1,662 @@
+#include "AHDBitGrid.h"
+#include "AHDParallel.h"
+#include "AHDException.h"
+#include <emmintrin.h>
+#include <algorithm>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+using namespace AHD;
+
+namespace
+{
+	//words handed to a thread at once by the whole grid operations
+	const size_t BLOCK_WORDS = 4096;
+
+	template<class Op>
+	void combineWords(BitGrid::Word* a, const BitGrid::Word* b, size_t count, Op op)
+	{
+		size_t i = 0;
+		for (; i + 2 <= count; i += 2)
+		{
+			__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+			__m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+			_mm_storeu_si128((__m128i*)(a + i), op(x, y));
+		}
+		if (i < count)
+		{
+			//the last word through the low half of a register
+			__m128i x = _mm_loadl_epi64((const __m128i*)(a + i));
+			__m128i y = _mm_loadl_epi64((const __m128i*)(b + i));
+			_mm_storel_epi64((__m128i*)(a + i), op(x, y));
+		}
+	}
+
+	//popcount of f(a[i], b[i]) over the whole grids, summed per block in parallel
+	template<class Func>
+	size_t countWords(const std::vector<BitGrid::Word>& a, const std::vector<BitGrid::Word>& b, Func f)
+	{
+		const size_t blocks = (a.size() + BLOCK_WORDS - 1) / BLOCK_WORDS;
+		std::vector<size_t> counts(blocks, 0);
+		parallelFor(0, blocks, [&](size_t block)
+		{
+			size_t begin = block * BLOCK_WORDS;
+			size_t end = std::min(begin + BLOCK_WORDS, a.size());
+			size_t n = 0;
+			for (size_t i = begin; i < end; ++i)
+				n += BitGrid::popcount(f(a[i], b[i]));
+			counts[block] = n;
+		});
+
+		size_t n = 0;
+		for (auto i : counts)
+			n += i;
+		return n;
+	}
+}
+
+BitGrid::BitGrid()
+{
+}
+
+BitGrid::BitGrid(int width, int height, int depth)
+{
+	resize(width, height, depth);
+}
+
+void BitGrid::resize(int width, int height, int depth)
+{
+	mWidth = std::max(width, 0);
+	mHeight = std::max(height, 0);
+	mDepth = std::max(depth, 0);
+	mWordsPerRow = (mWidth + WORD_BITS - 1) / WORD_BITS;
+	mBits.assign((size_t)mWordsPerRow * mHeight * mDepth, 0);
+}
+
+void BitGrid::clear()
+{
+	std::fill(mBits.begin(), mBits.end(), 0);
+}
+
+void BitGrid::fromVoxels(const VoxelData& data)
+{
+	fromVoxels(data, 0, 0, 0, data.width, data.height, data.depth);
+}
+
+void BitGrid::fromVoxels(const VoxelData& data, int x0, int y0, int z0, int width, int height, int depth)
+{
+	assert(x0 >= 0 && y0 >= 0 && z0 >= 0 &&
+		   x0 + width <= data.width && y0 + height <= data.height && z0 + depth <= data.depth);
+
+	resize(width, height, depth);
+
+	const int* voxels = (const int*)data.datas.data();
+	parallelFor(0, mDepth, [&](size_t z)
+	{
+		for (int y = 0; y < mHeight; ++y)
+		{
+			const int* src = voxels + ((size_t)(z + z0) * data.height + y + y0) * data.width + x0;
+			Word* row = getRow(y, (int)z);
+			for (int k = 0; k < mWordsPerRow; ++k)
+			{
+				int begin = k * WORD_BITS;
+				int end = std::min(begin + WORD_BITS, mWidth);
+				Word w = 0;
+				for (int x = begin; x < end; ++x)
+					w |= (Word)(src[x] != 0) << (x - begin);
+				row[k] = w;
+			}
+		}
+	});
+}
+
+void BitGrid::fromBits(const BitGrid& src, int x0, int y0, int z0, int width, int height, int depth)
+{
+	assert(x0 >= 0 && y0 >= 0 && z0 >= 0 &&
+		   x0 + width <= src.mWidth && y0 + height <= src.mHeight && z0 + depth <= src.mDepth);
+
+	resize(width, height, depth);
+	if (mWordsPerRow == 0)
+		return;
+
+	const int first = x0 / WORD_BITS;
+	const int shift = x0 % WORD_BITS;
+	const Word lastMask = getLastMask();
+	parallelFor(0, mDepth, [&](size_t z)
+	{
+		for (int y = 0; y < mHeight; ++y)
+		{
+			const Word* s = src.getRow(y + y0, (int)z + z0) + first;
+			Word* row = getRow(y, (int)z);
+			for (int k = 0; k < mWordsPerRow; ++k)
+			{
+				Word w = s[k] >> shift;
+				if (shift != 0 && first + k + 1 < src.mWordsPerRow)
+					w |= s[k + 1] << (WORD_BITS - shift);
+				row[k] = w;
+			}
+			row[mWordsPerRow - 1] &= lastMask;
+		}
+	});
+}
+
+void BitGrid::getFaces(FaceDirection face, int y, int z, Word* out, const BitGrid* exterior)const
+{
+	const Word* row = getRow(y, z);
+
+	if (exterior)
+	{
+		//a face is visible if the neighbour is exterior, the outside of the grid is
+		assert(exterior->mWidth == mWidth && exterior->mHeight == mHeight && exterior->mDepth == mDepth);
+		const Word* ext = exterior->getRow(y, z);
+		const Word lastBit = (Word)1 << ((mWidth - 1) % WORD_BITS);
+
+		switch (face)
+		{
+		case FD_POSITIVE_X:
+			for (int k = 0; k < mWordsPerRow; ++k)
+			{
+				Word next = k + 1 < mWordsPerRow ? ext[k + 1] << 63 : lastBit;
+				out[k] = row[k] & ((ext[k] >> 1) | next);
+			}
+			break;
+		case FD_NEGATIVE_X:
+			for (int k = 0; k < mWordsPerRow; ++k)
+			{
+				Word prev = k > 0 ? ext[k - 1] >> 63 : 1;
+				out[k] = row[k] & ((ext[k] << 1) | prev);
+			}
+			break;
+		default:
+			{
+				int ny = y, nz = z;
+				switch (face)
+				{
+				case FD_POSITIVE_Y: ++ny; break;
+				case FD_NEGATIVE_Y: --ny; break;
+				case FD_POSITIVE_Z: ++nz; break;
+				default: --nz; break;
+				}
+
+				if (ny < 0 || ny >= mHeight || nz < 0 || nz >= mDepth)
+				{
+					std::copy(row, row + mWordsPerRow, out);
+					break;
+				}
+
+				const Word* other = exterior->getRow(ny, nz);
+				for (int k = 0; k < mWordsPerRow; ++k)
+					out[k] = row[k] & other[k];
+			}
+			break;
+		}
+		return;
+	}
+
+	switch (face)
+	{
+	case FD_POSITIVE_X:
+		//the neighbour of bit 63 is bit 0 of the next word
+		for (int k = 0; k < mWordsPerRow; ++k)
+		{
+			Word next = k + 1 < mWordsPerRow ? row[k + 1] : 0;
+			out[k] = row[k] & ~((row[k] >> 1) | (next << 63));
+		}
+		break;
+	case FD_NEGATIVE_X:
+		for (int k = 0; k < mWordsPerRow; ++k)
+		{
+			Word prev = k > 0 ? row[k - 1] : 0;
+			out[k] = row[k] & ~((row[k] << 1) | (prev >> 63));
+		}
+		break;
+	default:
+		{
+			//y and z neighbours are whole rows
+			int ny = y, nz = z;
+			switch (face)
+			{
+			case FD_POSITIVE_Y: ++ny; break;
+			case FD_NEGATIVE_Y: --ny; break;
+			case FD_POSITIVE_Z: ++nz; break;
+			default: --nz; break;
+			}
+
+			if (ny < 0 || ny >= mHeight || nz < 0 || nz >= mDepth)
+			{
+				std::copy(row, row + mWordsPerRow, out);
+				break;
+			}
+
+			const Word* other = getRow(ny, nz);
+			for (int k = 0; k < mWordsPerRow; ++k)
+				out[k] = row[k] & ~other[k];
+		}
+		break;
+	}
+}
+
+void BitGrid::getFaces(FaceDirection face, std::vector<Word>& out, const BitGrid* exterior)const
+{
+	out.resize(mBits.size());
+	parallelFor(0, mDepth, [&](size_t z)
+	{
+		for (int y = 0; y < mHeight; ++y)
+			getFaces(face, y, (int)z, &out[(z * mHeight + y) * mWordsPerRow], exterior);
+	});
+}
+
+void BitGrid::getExterior(BitGrid& out)const
+{
+	out.resize(mWidth, mHeight, mDepth);
+	if (mBits.empty())
+		return;
+
+	//seeds are the empty voxels on the border of the grid, grown along their rows
+	const Word lastMask = getLastMask();
+	const Word lastBit = (Word)1 << ((mWidth - 1) % WORD_BITS);
+	parallelFor(0, mDepth, [&](size_t z)
+	{
+		std::vector<Word> empty(mWordsPerRow);
+		for (int y = 0; y < mHeight; ++y)
+		{
+			const Word* row = getRow(y, (int)z);
+			Word* ext = out.getRow(y, (int)z);
+			bool border = y == 0 || y == mHeight - 1 || z == 0 || (int)z == mDepth - 1;
+			for (int k = 0; k < mWordsPerRow; ++k)
+			{
+				empty[k] = ~row[k] & (k + 1 < mWordsPerRow ? ~(Word)0 : lastMask);
+				Word seeds = border ? ~(Word)0 : 0;
+				if (k == 0)
+					seeds |= 1;
+				if (k + 1 == mWordsPerRow)
+					seeds |= lastBit;
+				ext[k] = empty[k] & seeds;
+			}
+			fillRow(ext, empty.data(), mWordsPerRow);
+		}
+	});
+
+	//slices are filled in two phases of even and odd z, so the neighbour slices a thread reads are not written meanwhile.
+	//only slices next to a changed one are filled again
+	std::vector<char> dirty(mDepth, 1);
+	std::vector<char> changed(mDepth, 0);
+	bool any = true;
+	while (any)
+	{
+		any = false;
+		for (int phase = 0; phase < 2; ++phase)
+		{
+			parallelFor(0, (mDepth + 1 - phase) / 2, [&](size_t i)
+			{
+				int z = (int)i * 2 + phase;
+				if (!dirty[z])
+					return;
+
+				std::vector<Word> empty(mWordsPerRow);
+				dirty[z] = 0;
+				changed[z] = fillExteriorSlice(out, z, empty) ? 1 : 0;
+			});
+
+			for (int z = phase; z < mDepth; z += 2)
+			{
+				if (!changed[z])
+					continue;
+
+				changed[z] = 0;
+				if (z > 0)
+					dirty[z - 1] = 1;
+				if (z + 1 < mDepth)
+					dirty[z + 1] = 1;
+				any = true;
+			}
+		}
+	}
+}
+
+bool BitGrid::fillExteriorSlice(BitGrid& exterior, int z, std::vector<Word>& empty)const
+{
+	const Word lastMask = getLastMask();
+	bool changed = false;
+	bool sliceChanged = true;
+	while (sliceChanged)
+	{
+		sliceChanged = false;
+		//a sweep up and a sweep down the slice
+		for (int i = 0; i < mHeight * 2; ++i)
+		{
+			int y = i < mHeight ? i : mHeight * 2 - 1 - i;
+			const Word* row = getRow(y, z);
+			Word* ext = exterior.getRow(y, z);
+
+			const Word* neighbours[4] =
+			{
+				y > 0 ? exterior.getRow(y - 1, z) : NULL,
+				y + 1 < mHeight ? exterior.getRow(y + 1, z) : NULL,
+				z > 0 ? exterior.getRow(y, z - 1) : NULL,
+				z + 1 < mDepth ? exterior.getRow(y, z + 1) : NULL,
+			};
+
+			bool any = false;
+			for (int k = 0; k < mWordsPerRow; ++k)
+			{
+				empty[k] = ~row[k] & (k + 1 < mWordsPerRow ? ~(Word)0 : lastMask);
+				Word w = ext[k];
+				for (int j = 0; j < 4; ++j)
+				{
+					if (neighbours[j])
+						w |= neighbours[j][k];
+				}
+				w &= empty[k];
+				if (w != ext[k])
+					any = true;
+				ext[k] = w;
+			}
+
+			if (!any)
+				continue;
+
+			fillRow(ext, empty.data(), mWordsPerRow);
+			sliceChanged = true;
+			changed = true;
+		}
+	}
+	return changed;
+}
+
+void BitGrid::fillRow(Word* row, const Word* mask, int words)
+{
+	//occluded fill in log steps per word, carried over to the next word on the way up and to the previous one on the way down
+	for (int k = 0; k < words; ++k)
+	{
+		Word e = row[k];
+		Word m = mask[k];
+		if (k > 0 && (row[k - 1] >> 63) != 0)
+			e |= m & 1;
+		e |= (e << 1) & m; m &= m << 1;
+		e |= (e << 2) & m; m &= m << 2;
+		e |= (e << 4) & m; m &= m << 4;
+		e |= (e << 8) & m; m &= m << 8;
+		e |= (e << 16) & m; m &= m << 16;
+		e |= (e << 32) & m;
+		row[k] = e;
+	}
+
+	for (int k = words - 1; k >= 0; --k)
+	{
+		Word e = row[k];
+		Word m = mask[k];
+		if (k + 1 < words && (row[k + 1] & 1) != 0)
+			e |= m & ((Word)1 << 63);
+		e |= (e >> 1) & m; m &= m >> 1;
+		e |= (e >> 2) & m; m &= m >> 2;
+		e |= (e >> 4) & m; m &= m >> 4;
+		e |= (e >> 8) & m; m &= m >> 8;
+		e |= (e >> 16) & m; m &= m >> 16;
+		e |= (e >> 32) & m;
+		row[k] = e;
+	}
+}
+
+BitGrid::Word BitGrid::getLastMask()const
+{
+	int bits = mWidth % WORD_BITS;
+	return bits == 0 ? ~(Word)0 : ((Word)1 << bits) - 1;
+}
+
+void BitGrid::combine(const BitGrid& rhs, BooleanOp op)
+{
+	if (rhs.mWidth != mWidth || rhs.mHeight != mHeight || rhs.mDepth != mDepth)
+		EXCEPT("the grids have different sizes");
+
+	const size_t blocks = (mBits.size() + BLOCK_WORDS - 1) / BLOCK_WORDS;
+	parallelFor(0, blocks, [&](size_t block)
+	{
+		size_t begin = block * BLOCK_WORDS;
+		size_t count = std::min(BLOCK_WORDS, mBits.size() - begin);
+		Word* a = &mBits[begin];
+		const Word* b = &rhs.mBits[begin];
+		switch (op)
+		{
+		case BO_UNION:
+			combineWords(a, b, count, [](__m128i x, __m128i y){ return _mm_or_si128(x, y); });
+			break;
+		case BO_INTERSECTION:
+			combineWords(a, b, count, [](__m128i x, __m128i y){ return _mm_and_si128(x, y); });
+			break;
+		case BO_DIFFERENCE:
+			//andnot complements its first operand
+			combineWords(a, b, count, [](__m128i x, __m128i y){ return _mm_andnot_si128(y, x); });
+			break;
+		case BO_XOR:
+			combineWords(a, b, count, [](__m128i x, __m128i y){ return _mm_xor_si128(x, y); });
+			break;
+		}
+	});
+}
+
+void BitGrid::dilate(int radius)
+{
+	if (radius <= 0 || mBits.empty())
+		return;
+
+	morphX(radius, false);
+	morphRows(radius, false, 1);
+	morphRows(radius, false, 2);
+}
+
+void BitGrid::erode(int radius)
+{
+	if (radius <= 0 || mBits.empty())
+		return;
+
+	morphX(radius, true);
+	morphRows(radius, true, 1);
+	morphRows(radius, true, 2);
+}
+
+void BitGrid::open(int radius)
+{
+	erode(radius);
+	dilate(radius);
+}
+
+void BitGrid::close(int radius)
+{
+	dilate(radius);
+	erode(radius);
+}
+
+void BitGrid::morphX(int radius, bool erode)
+{
+	//radius steps of one voxel to both sides, 64 voxels per shift.
+	//for erosion the bits past the width are set while working, they stand for the filled outside
+	const Word lastMask = getLastMask();
+	const Word outside = erode ? ~(Word)0 : 0;
+	parallelFor(0, mDepth, [&](size_t z)
+	{
+		std::vector<Word> temp(mWordsPerRow);
+		for (int y = 0; y < mHeight; ++y)
+		{
+			Word* row = getRow(y, (int)z);
+			if (erode)
+				row[mWordsPerRow - 1] |= ~lastMask;
+
+			for (int step = 0; step < radius; ++step)
+			{
+				std::copy(row, row + mWordsPerRow, temp.begin());
+				for (int k = 0; k < mWordsPerRow; ++k)
+				{
+					Word prev = k > 0 ? temp[k - 1] : outside;
+					Word next = k + 1 < mWordsPerRow ? temp[k + 1] : outside;
+					Word left = (temp[k] << 1) | (prev >> 63);
+					Word right = (temp[k] >> 1) | (next << 63);
+					row[k] = erode ? (temp[k] & left & right) : (temp[k] | left | right);
+				}
+			}
+
+			row[mWordsPerRow - 1] &= lastMask;
+		}
+	});
+}
+
+void BitGrid::morphRows(int radius, bool erode, int axis)
+{
+	//every row becomes the or (and) of the rows within radius along y or z, rows outside of the grid are skipped
+	std::vector<Word> src(mBits);
+	const int length = axis == 1 ? mHeight : mDepth;
+	parallelFor(0, mDepth, [&](size_t z)
+	{
+		for (int y = 0; y < mHeight; ++y)
+		{
+			const int i = axis == 1 ? y : (int)z;
+			const int begin = std::max(i - radius, 0);
+			const int end = std::min(i + radius, length - 1);
+
+			Word* row = getRow(y, (int)z);
+			for (int j = begin; j <= end; ++j)
+			{
+				const Word* other = &src[((axis == 1 ? z * mHeight + j : (size_t)j * mHeight + y)) * mWordsPerRow];
+				for (int k = 0; k < mWordsPerRow; ++k)
+					row[k] = erode ? (row[k] & other[k]) : (row[k] | other[k]);
+			}
+		}
+	});
+}
+
+void BitGrid::toVoxels(VoxelData& data, int fill)const
+{
+	if (data.width != mWidth || data.height != mHeight || data.depth != mDepth)
+		EXCEPT("the voxel data has a different size");
+
+	int* voxels = (int*)data.datas.data();
+	parallelFor(0, mDepth, [&](size_t z)
+	{
+		for (int y = 0; y < mHeight; ++y)
+		{
+			int* dst = voxels + ((size_t)z * mHeight + y) * mWidth;
+			for (int x = 0; x < mWidth; ++x)
+			{
+				if (!get(x, y, (int)z))
+					dst[x] = 0;
+				else if (dst[x] == 0)
+					dst[x] = fill;
+			}
+		}
+	});
+}
+
+bool BitGrid::any(int x0, int y0, int z0, int x1, int y1, int z1)const
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	z0 = std::max(z0, 0);
+	x1 = std::min(x1, mWidth);
+	y1 = std::min(y1, mHeight);
+	z1 = std::min(z1, mDepth);
+	if (x0 >= x1 || y0 >= y1 || z0 >= z1)
+		return false;
+
+	const int first = x0 / WORD_BITS;
+	const int last = (x1 - 1) / WORD_BITS;
+	Word firstMask = ~(Word)0 << (x0 % WORD_BITS);
+	const Word lastMask = ~(Word)0 >> (WORD_BITS - 1 - (x1 - 1) % WORD_BITS);
+	if (first == last)
+		firstMask &= lastMask;
+
+	for (int z = z0; z < z1; ++z)
+	{
+		for (int y = y0; y < y1; ++y)
+		{
+			const Word* row = getRow(y, z);
+			if (row[first] & firstMask)
+				return true;
+			if (first == last)
+				continue;
+			for (int k = first + 1; k < last; ++k)
+			{
+				if (row[k])
+					return true;
+			}
+			if (row[last] & lastMask)
+				return true;
+		}
+	}
+	return false;
+}
+
+void BitGrid::reduce(BitGrid& out, int factor)const
+{
+	assert(factor > 0 && &out != this);
+	out.resize((mWidth + factor - 1) / factor, (mHeight + factor - 1) / factor, (mDepth + factor - 1) / factor);
+
+	parallelFor(0, out.mDepth, [&](size_t z)
+	{
+		const int z0 = (int)z * factor;
+		for (int y = 0; y < out.mHeight; ++y)
+		{
+			const int y0 = y * factor;
+			for (int x = 0; x < out.mWidth; ++x)
+			{
+				const int x0 = x * factor;
+				if (any(x0, y0, z0, x0 + factor, y0 + factor, z0 + factor))
+					out.set(x, y, (int)z, true);
+			}
+		}
+	});
+}
+
+size_t BitGrid::count()const
+{
+	return countWords(mBits, mBits, [](Word a, Word){ return a; });
+}
+
+size_t BitGrid::countOverlap(const BitGrid& a, const BitGrid& b)
+{
+	if (a.mWidth != b.mWidth || a.mHeight != b.mHeight || a.mDepth != b.mDepth)
+		EXCEPT("the grids have different sizes");
+
+	return countWords(a.mBits, b.mBits, [](Word x, Word y){ return x & y; });
+}
+
+double BitGrid::getOverlapRatio(const BitGrid& a, const BitGrid& b)
+{
+	if (a.mWidth != b.mWidth || a.mHeight != b.mHeight || a.mDepth != b.mDepth)
+		EXCEPT("the grids have different sizes");
+
+	size_t overlap = countWords(a.mBits, b.mBits, [](Word x, Word y){ return x & y; });
+	size_t all = countWords(a.mBits, b.mBits, [](Word x, Word y){ return x | y; });
+	return all == 0 ? 0.0 : (double)overlap / all;
+}
+
+int BitGrid::popcount(Word w)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(w);
+#else
+	//the popcnt instruction is not guaranteed on every x86 cpu
+	w = w - ((w >> 1) & 0x5555555555555555ULL);
+	w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+	w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+	return (int)((w * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+int BitGrid::ctz(Word w)
+{
+	assert(w != 0);
+#if defined(__GNUC__)
+	return __builtin_ctzll(w);
+#elif defined(_M_X64)
+	unsigned long i;
+	_BitScanForward64(&i, w);
+	return (int)i;
+#else
+	unsigned long i;
+	if (_BitScanForward(&i, (unsigned long)w))
+		return (int)i;
+	_BitScanForward(&i, (unsigned long)(w >> 32));
+	return (int)i + 32;
+#endif
+}
@@ -0,0 +1,132 @@
+#ifndef _AHDBitGrid_H_
+#define _AHDBitGrid_H_
+
+#include "AHDUtils.h"
+#include <vector>
+
+namespace AHD
+{
+	//same order as the faces of the mesher
+	enum FaceDirection
+	{
+		FD_POSITIVE_X,
+		FD_POSITIVE_Y,
+		FD_POSITIVE_Z,
+		FD_NEGATIVE_X,
+		FD_NEGATIVE_Y,
+		FD_NEGATIVE_Z,
+	};
+
+	enum BooleanOp
+	{
+		BO_UNION,
+		BO_INTERSECTION,
+		BO_DIFFERENCE,//set in this grid and not in the other one
+		BO_XOR,
+	};
+
+	//one bit per voxel. x runs along the bits of 64 bit words, every (y, z) has its own row of
+	//getWordsPerRow() words, so a row operation handles 64 voxels at once.
+	//bits past the width are always 0
+	class BitGrid
+	{
+	public:
+		typedef unsigned long long Word;
+		static const int WORD_BITS = 64;
+
+		BitGrid();
+		BitGrid(int width, int height, int depth);
+
+		//resizes and clears
+		void resize(int width, int height, int depth);
+		void clear();
+		//sets every voxel with a non zero element of data
+		void fromVoxels(const VoxelData& data);
+		//the same for the box at (x0, y0, z0) of data, which becomes (0, 0, 0). the box has to be inside data
+		void fromVoxels(const VoxelData& data, int x0, int y0, int z0, int width, int height, int depth);
+		//copies the box at (x0, y0, z0) of src, the box has to be inside src
+		void fromBits(const BitGrid& src, int x0, int y0, int z0, int width, int height, int depth);
+		//writes the grid back to data of the same size: cleared voxels become 0, new voxels get color fill,
+		//the others keep their color
+		void toVoxels(VoxelData& data, int fill)const;
+
+		int getWidth()const{ return mWidth; }
+		int getHeight()const{ return mHeight; }
+		int getDepth()const{ return mDepth; }
+		int getWordsPerRow()const{ return mWordsPerRow; }
+
+		bool get(int x, int y, int z)const
+		{
+			return ((getRow(y, z)[x >> 6] >> (x & 63)) & 1) != 0;
+		}
+		void set(int x, int y, int z, bool v)
+		{
+			Word bit = (Word)1 << (x & 63);
+			Word& w = getRow(y, z)[x >> 6];
+			w = v ? (w | bit) : (w & ~bit);
+		}
+
+		Word* getRow(int y, int z){ return &mBits[((size_t)z * mHeight + y) * mWordsPerRow]; }
+		const Word* getRow(int y, int z)const{ return &mBits[((size_t)z * mHeight + y) * mWordsPerRow]; }
+
+		//bits of the voxels whose face in direction face is visible, for the row (y, z).
+		//outside of the grid counts as empty. with exterior (same size as this grid), only faces against
+		//exterior voxels or the outside of the grid are visible
+		void getFaces(FaceDirection face, int y, int z, Word* out, const BitGrid* exterior = NULL)const;
+		//the same for all rows, out gets the layout of the grid
+		void getFaces(FaceDirection face, std::vector<Word>& out, const BitGrid* exterior = NULL)const;
+
+		//the empty voxels connected to the outside of the grid through empty face neighbours.
+		//what is neither set nor exterior is a sealed cavity
+		void getExterior(BitGrid& out)const;
+
+		//combines rhs into this grid, 128 bits at a time. both grids need the same size
+		void combine(const BitGrid& rhs, BooleanOp op);
+
+		//morphology with a cube of 2 * radius + 1 voxels, one axis after the other.
+		//the outside of the grid counts as empty for dilation and as filled for erosion,
+		//so closing never clears a voxel and opening never sets one
+		void dilate(int radius);
+		void erode(int radius);
+		//erode then dilate, removes parts thinner than the cube
+		void open(int radius);
+		//dilate then erode, fills holes and gaps smaller than the cube
+		void close(int radius);
+
+		//whether any voxel of [x0, x1) x [y0, y1) x [z0, z1) is set, the box is clipped to the grid
+		bool any(int x0, int y0, int z0, int x1, int y1, int z1)const;
+		//out gets one voxel per block of factor^3 voxels, set when any voxel of the block is
+		void reduce(BitGrid& out, int factor)const;
+
+		//set voxels, the volume in voxels
+		size_t count()const;
+		//voxels set in both grids, without building the intersection
+		static size_t countOverlap(const BitGrid& a, const BitGrid& b);
+		//overlap over union of the set voxels, 0 when both grids are empty
+		static double getOverlapRatio(const BitGrid& a, const BitGrid& b);
+
+		static int popcount(Word w);
+		//index of the lowest set bit, w must not be 0
+		static int ctz(Word w);
+
+	private:
+		//the bits of the last word of a row that are inside the width
+		Word getLastMask()const;
+		//grows the set bits of row along runs of set bits in mask, both ways and across words
+		static void fillRow(Word* row, const Word* mask, int words);
+		//one slice of getExterior, until it stops changing. returns true if anything changed
+		bool fillExteriorSlice(BitGrid& exterior, int z, std::vector<Word>& empty)const;
+		//dilation or erosion along x, y and z
+		void morphX(int radius, bool erode);
+		void morphRows(int radius, bool erode, int axis);
+
+	private:
+		int mWidth = 0;
+		int mHeight = 0;
+		int mDepth = 0;
+		int mWordsPerRow = 0;
+		std::vector<Word> mBits;
+	};
+}
+
+#endif
@@ -0,0 +1,217 @@
+#include "AHDComponents.h"
+#include "AHDParallel.h"
+#include <algorithm>
+#include <limits.h>
+
+using namespace AHD;
+
+namespace
+{
+	const unsigned int NO_LABEL = 0xffffffff;
+
+	//slices of a slab, slabs are labelled in parallel and joined afterwards
+	const int SLAB_DEPTH = 8;
+
+	//the neighbours visited before a voxel in scan order, the first 3 are the face neighbours
+	const int BACKWARD[13][3] =
+	{
+		{ -1, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 },
+		{ -1, -1, 0 }, { 1, -1, 0 },
+		{ -1, -1, -1 }, { 0, -1, -1 }, { 1, -1, -1 },
+		{ -1, 0, -1 }, { 1, 0, -1 },
+		{ -1, 1, -1 }, { 0, 1, -1 }, { 1, 1, -1 },
+	};
+
+	//union find with the smallest voxel index as root, so the roots do not depend on the order of the unions
+	unsigned int findRoot(std::vector<unsigned int>& parent, unsigned int i)
+	{
+		while (parent[i] != i)
+		{
+			parent[i] = parent[parent[i]];
+			i = parent[i];
+		}
+		return i;
+	}
+
+	void unite(std::vector<unsigned int>& parent, unsigned int a, unsigned int b)
+	{
+		a = findRoot(parent, a);
+		b = findRoot(parent, b);
+		if (a < b)
+			parent[b] = a;
+		else if (b < a)
+			parent[a] = b;
+	}
+}
+
+void AHD::labelComponents(const BitGrid& grid, Connectivity connectivity, std::vector<unsigned int>& labels, std::vector<VoxelComponent>& components)
+{
+	const int width = grid.getWidth();
+	const int height = grid.getHeight();
+	const int depth = grid.getDepth();
+	const size_t sliceSize = (size_t)width * height;
+	const int words = grid.getWordsPerRow();
+	const int neighbours = connectivity == CN_6 ? 3 : 13;
+
+	components.clear();
+	labels.assign(sliceSize * depth, 0);
+	if (labels.empty())
+		return;
+
+	std::vector<unsigned int> parent(labels.size(), NO_LABEL);
+
+	//joins voxel (x, y, z) with its filled backward neighbours, from slice minZ on
+	auto joinNeighbours = [&](int x, int y, int z, int minZ)
+	{
+		unsigned int index = (unsigned int)(z * sliceSize + (size_t)y * width + x);
+		for (int i = 0; i < neighbours; ++i)
+		{
+			int nx = x + BACKWARD[i][0];
+			int ny = y + BACKWARD[i][1];
+			int nz = z + BACKWARD[i][2];
+			if (nx < 0 || nx >= width || ny < 0 || ny >= height || nz < minZ)
+				continue;
+			if (grid.get(nx, ny, nz))
+				unite(parent, index, (unsigned int)(nz * sliceSize + (size_t)ny * width + nx));
+		}
+	};
+
+	//pass 1: every slab on its own, unions stay inside the slab
+	const int slabs = (depth + SLAB_DEPTH - 1) / SLAB_DEPTH;
+	parallelFor(0, slabs, [&](size_t slab)
+	{
+		const int begin = (int)slab * SLAB_DEPTH;
+		const int end = std::min(begin + SLAB_DEPTH, depth);
+		for (int z = begin; z < end; ++z)
+		{
+			for (int y = 0; y < height; ++y)
+			{
+				const BitGrid::Word* row = grid.getRow(y, z);
+				for (int k = 0; k < words; ++k)
+				{
+					for (BitGrid::Word m = row[k]; m != 0; m &= m - 1)
+					{
+						int x = k * BitGrid::WORD_BITS + BitGrid::ctz(m);
+						unsigned int index = (unsigned int)(z * sliceSize + (size_t)y * width + x);
+						parent[index] = index;
+						joinNeighbours(x, y, z, begin);
+					}
+				}
+			}
+		}
+	});
+
+	//pass 2: the first slice of every slab joins the last slice of the slab before
+	for (int slab = 1; slab < slabs; ++slab)
+	{
+		const int z = slab * SLAB_DEPTH;
+		for (int y = 0; y < height; ++y)
+		{
+			const BitGrid::Word* row = grid.getRow(y, z);
+			for (int k = 0; k < words; ++k)
+			{
+				for (BitGrid::Word m = row[k]; m != 0; m &= m - 1)
+				{
+					int x = k * BitGrid::WORD_BITS + BitGrid::ctz(m);
+					joinNeighbours(x, y, z, z - 1);
+				}
+			}
+		}
+	}
+
+	//pass 3: roots without changing the union find, then the roots of every slab are numbered by prefix sum
+	parallelFor(0, slabs, [&](size_t slab)
+	{
+		const size_t begin = slab * SLAB_DEPTH * sliceSize;
+		const size_t end = std::min((slab + 1) * SLAB_DEPTH, (size_t)depth) * sliceSize;
+		for (size_t i = begin; i < end; ++i)
+		{
+			unsigned int p = parent[i];
+			if (p == NO_LABEL)
+				continue;
+			while (parent[p] != p)
+				p = parent[p];
+			labels[i] = p;
+		}
+	});
+
+	std::vector<size_t> roots(slabs + 1, 0);
+	parallelFor(0, slabs, [&](size_t slab)
+	{
+		const size_t begin = slab * SLAB_DEPTH * sliceSize;
+		const size_t end = std::min((slab + 1) * SLAB_DEPTH, (size_t)depth) * sliceSize;
+		size_t n = 0;
+		for (size_t i = begin; i < end; ++i)
+			n += parent[i] == i;
+		roots[slab + 1] = n;
+	});
+	for (int slab = 0; slab < slabs; ++slab)
+		roots[slab + 1] += roots[slab];
+
+	//the parent of a root is not needed any more, it keeps the component index
+	parallelFor(0, slabs, [&](size_t slab)
+	{
+		const size_t begin = slab * SLAB_DEPTH * sliceSize;
+		const size_t end = std::min((slab + 1) * SLAB_DEPTH, (size_t)depth) * sliceSize;
+		unsigned int next = (unsigned int)roots[slab];
+		for (size_t i = begin; i < end; ++i)
+		{
+			if (parent[i] == i)
+				parent[i] = next++;
+		}
+	});
+
+	//pass 4: final labels
+	parallelFor(0, slabs, [&](size_t slab)
+	{
+		const size_t begin = slab * SLAB_DEPTH * sliceSize;
+		const size_t end = std::min((slab + 1) * SLAB_DEPTH, (size_t)depth) * sliceSize;
+		for (size_t i = begin; i < end; ++i)
+		{
+			if (parent[i] != NO_LABEL)
+				labels[i] = parent[labels[i]] + 1;
+		}
+	});
+
+	//statistics in one pass over the filled voxels, a component can span any number of slabs
+	components.resize(roots.back());
+	for (auto& c : components)
+	{
+		c.count = 0;
+		for (int i = 0; i < 3; ++i)
+		{
+			c.min[i] = INT_MAX;
+			c.max[i] = INT_MIN;
+		}
+	}
+	for (int z = 0; z < depth; ++z)
+	{
+		for (int y = 0; y < height; ++y)
+		{
+			const BitGrid::Word* row = grid.getRow(y, z);
+			const unsigned int* rowLabels = &labels[z * sliceSize + (size_t)y * width];
+			for (int k = 0; k < words; ++k)
+			{
+				for (BitGrid::Word m = row[k]; m != 0; m &= m - 1)
+				{
+					int x = k * BitGrid::WORD_BITS + BitGrid::ctz(m);
+					VoxelComponent& c = components[rowLabels[x] - 1];
+					++c.count;
+					c.min[0] = std::min(c.min[0], x);
+					c.max[0] = std::max(c.max[0], x);
+					c.min[1] = std::min(c.min[1], y);
+					c.max[1] = std::max(c.max[1], y);
+					c.min[2] = std::min(c.min[2], z);
+					c.max[2] = std::max(c.max[2], z);
+				}
+			}
+		}
+	}
+}
+
+void AHD::labelComponents(const VoxelData& data, Connectivity connectivity, std::vector<unsigned int>& labels, std::vector<VoxelComponent>& components)
+{
+	BitGrid grid;
+	grid.fromVoxels(data);
+	labelComponents(grid, connectivity, labels, components);
+}
@@ -0,0 +1,30 @@
+#ifndef _AHDComponents_H_
+#define _AHDComponents_H_
+
+#include "AHDUtils.h"
+#include "AHDBitGrid.h"
+#include <vector>
+
+namespace AHD
+{
+	enum Connectivity
+	{
+		CN_6,//voxels sharing a face
+		CN_26,//voxels sharing a face, an edge or a corner
+	};
+
+	struct VoxelComponent
+	{
+		size_t count;
+		//the first and last voxel of the component along every axis
+		int min[3];
+		int max[3];
+	};
+
+	//labels the connected components of the filled voxels. labels gets one element per voxel in the layout of VoxelData,
+	//0 for empty voxels and 1 + the index in components otherwise. components are ordered by their first voxel
+	void labelComponents(const BitGrid& grid, Connectivity connectivity, std::vector<unsigned int>& labels, std::vector<VoxelComponent>& components);
+	void labelComponents(const VoxelData& data, Connectivity connectivity, std::vector<unsigned int>& labels, std::vector<VoxelComponent>& components);
+}
+
+#endif
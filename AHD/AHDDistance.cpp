@@ -0,0 +1,169 @@
+#include "AHDDistance.h"
+#include "AHDParallel.h"
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+using namespace AHD;
+
+namespace
+{
+	//squared distances are integers, kept exact where a float would round them past 2^24
+	typedef unsigned int Square;
+	const Square INF = std::numeric_limits<Square>::max();
+
+	//squared distance transform of one line by the lower envelope of the parabolas rooted at the finite samples
+	//(Felzenszwalb and Huttenlocher). the intersections of the envelope are the fractions zn / zd, compared by
+	//cross multiplying in 64 bits. v, zn and zd are scratch of n + 1 elements
+	void transformLine(const Square* f, Square* d, int n, int* v, long long* zn, long long* zd)
+	{
+		int k = -1;
+		for (int q = 0; q < n; ++q)
+		{
+			if (f[q] == INF)
+				continue;
+
+			if (k < 0)
+			{
+				k = 0;
+				v[0] = q;
+				continue;
+			}
+
+			//drop the parabolas hidden by the one at q, the first one always stays
+			long long sn, sd;
+			for (;;)
+			{
+				int p = v[k];
+				sn = ((long long)f[q] + (long long)q * q) - ((long long)f[p] + (long long)p * p);
+				sd = 2 * (q - p);
+				if (k == 0 || sn * zd[k] > zn[k] * sd)
+					break;
+				--k;
+			}
+
+			++k;
+			v[k] = q;
+			zn[k] = sn;
+			zd[k] = sd;
+		}
+
+		if (k < 0)
+		{
+			std::fill(d, d + n, INF);
+			return;
+		}
+
+		const int last = k;
+		k = 0;
+		for (int q = 0; q < n; ++q)
+		{
+			while (k < last && zn[k + 1] < q * zd[k + 1])
+				++k;
+			long long dq = q - v[k];
+			d[q] = (Square)(dq * dq + f[v[k]]);
+		}
+	}
+
+	float getDistance(Square square)
+	{
+		return square == INF ? std::numeric_limits<float>::infinity() : (float)sqrt((double)square);
+	}
+
+	//squared distances to the voxels whose bit equals target
+	void transformGrid(const BitGrid& grid, bool target, std::vector<Square>& out)
+	{
+		const int width = grid.getWidth();
+		const int height = grid.getHeight();
+		const int depth = grid.getDepth();
+		const size_t sliceSize = (size_t)width * height;
+		out.resize(sliceSize * depth);
+		//the largest squared distance has to fit
+		assert((double)(width - 1) * (width - 1) + (double)(height - 1) * (height - 1) + (double)(depth - 1) * (depth - 1) < (double)INF);
+
+		const int maxLength = std::max(width, std::max(height, depth));
+
+		//x: rows straight from the bits
+		parallelFor(0, depth, [&](size_t z)
+		{
+			std::vector<Square> f(width);
+			std::vector<int> v(width + 1);
+			std::vector<long long> zn(width + 1), zd(width + 1);
+			for (int y = 0; y < height; ++y)
+			{
+				for (int x = 0; x < width; ++x)
+					f[x] = grid.get(x, y, (int)z) == target ? 0 : INF;
+				transformLine(f.data(), &out[z * sliceSize + (size_t)y * width], width, v.data(), zn.data(), zd.data());
+			}
+		});
+
+		//y and z: columns gathered into lines, transformed and written back.
+		//BLOCK neighbouring columns are gathered together so every cache line read is used
+		const int BLOCK = 16;
+		auto transformColumns = [&](int axis)
+		{
+			const int length = axis == 1 ? height : depth;
+			const int other = axis == 1 ? depth : height;
+			const size_t step = axis == 1 ? (size_t)width : sliceSize;
+			parallelFor(0, other, [&](size_t o)
+			{
+				std::vector<Square> f((size_t)maxLength * BLOCK);
+				std::vector<Square> d(maxLength);
+				std::vector<int> v(maxLength + 1);
+				std::vector<long long> zn(maxLength + 1), zd(maxLength + 1);
+				const size_t base = axis == 1 ? o * sliceSize : o * width;
+				for (int x0 = 0; x0 < width; x0 += BLOCK)
+				{
+					const int columns = std::min(BLOCK, width - x0);
+					Square* block = &out[base + x0];
+					for (int i = 0; i < length; ++i)
+					{
+						for (int j = 0; j < columns; ++j)
+							f[(size_t)j * length + i] = block[i * step + j];
+					}
+
+					for (int j = 0; j < columns; ++j)
+					{
+						transformLine(&f[(size_t)j * length], d.data(), length, v.data(), zn.data(), zd.data());
+						std::copy(d.begin(), d.begin() + length, f.begin() + (size_t)j * length);
+					}
+
+					for (int i = 0; i < length; ++i)
+					{
+						for (int j = 0; j < columns; ++j)
+							block[i * step + j] = f[(size_t)j * length + i];
+					}
+				}
+			});
+		};
+		transformColumns(1);
+		transformColumns(2);
+	}
+}
+
+void AHD::computeDistanceField(const BitGrid& grid, std::vector<float>& out, bool signedDistance)
+{
+	std::vector<Square> squares;
+	transformGrid(grid, true, squares);
+	out.resize(squares.size());
+	parallelFor(0, out.size(), [&](size_t i)
+	{
+		out[i] = getDistance(squares[i]);
+	}, 4096);
+
+	if (!signedDistance)
+		return;
+
+	transformGrid(grid, false, squares);
+	parallelFor(0, out.size(), [&](size_t i)
+	{
+		out[i] -= getDistance(squares[i]);
+	}, 4096);
+}
+
+void AHD::computeDistanceField(const VoxelData& data, std::vector<float>& out, bool signedDistance)
+{
+	BitGrid grid;
+	grid.fromVoxels(data);
+	computeDistanceField(grid, out, signedDistance);
+}
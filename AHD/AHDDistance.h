@@ -0,0 +1,18 @@
+#ifndef _AHDDistance_H_
+#define _AHDDistance_H_
+
+#include "AHDUtils.h"
+#include "AHDBitGrid.h"
+#include <vector>
+
+namespace AHD
+{
+	//exact euclidean distance field of a voxel grid, in voxel units between voxel centers.
+	//out gets one float per voxel in the layout of VoxelData.
+	//unsigned: the distance to the nearest filled voxel, 0 on filled voxels, infinity when nothing is filled.
+	//signed: that distance outside, and minus the distance to the nearest empty voxel inside
+	void computeDistanceField(const BitGrid& grid, std::vector<float>& out, bool signedDistance = false);
+	void computeDistanceField(const VoxelData& data, std::vector<float>& out, bool signedDistance = false);
+}
+
+#endif
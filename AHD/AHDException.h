@@ -0,0 +1,9 @@
+#ifndef _AHDException_H_
+#define _AHDException_H_
+
+#include <stdexcept>
+
+//error reporting of the library sources, not meant for the public headers
+#define EXCEPT(x) {throw std::runtime_error(x);}
+
+#endif
@@ -0,0 +1,509 @@
+#include "AHDMesher.h"
+#include "AHDParallel.h"
+#include "AHDException.h"
+#include <algorithm>
+#include <unordered_map>
+
+using namespace AHD;
+
+namespace
+{
+	//the 6 faces, in the order P_X, P_Y, P_Z, N_X, N_Y, N_Z
+	struct FaceInfo
+	{
+		int axis;//normal axis
+		int sign;
+		int u, v;//axes spanning the face
+		int corners[4][2];//quad corners in (u, v), keeps the winding of the old per voxel cube
+	};
+
+	//all 4 corners of a face unoccluded
+	const int NO_OCCLUSION = 0xff;
+
+	const FaceInfo FACES[6] =
+	{
+		{ 0, 1, 1, 2, { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } } },
+		{ 1, 1, 0, 2, { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } } },
+		{ 2, 1, 0, 1, { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } } },
+		{ 0, -1, 1, 2, { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } } },
+		{ 1, -1, 0, 2, { { 0, 0 }, { 0, 1 }, { 1, 1 }, { 1, 0 } } },
+		{ 2, -1, 0, 1, { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 1 } } },
+	};
+}
+
+unsigned short Palette::addColor(int color)
+{
+	auto i = mIndexes.find(color);
+	if (i != mIndexes.end())
+		return i->second;
+
+	if (mColors.size() > 0xffff)
+		EXCEPT("too many colors for a palette");
+
+	unsigned short index = (unsigned short)mColors.size();
+	mColors.push_back(color);
+	mIndexes[color] = index;
+	return index;
+}
+
+unsigned short Palette::getIndex(int color)const
+{
+	auto i = mIndexes.find(color);
+	assert(i != mIndexes.end());
+	return i->second;
+}
+
+void Palette::clear()
+{
+	mColors.clear();
+	mIndexes.clear();
+}
+
+void Mesher::setMode(MeshMode mode)
+{
+	mMode = mode;
+}
+
+void Mesher::setRegion(int x0, int y0, int z0, int x1, int y1, int z1)
+{
+	mRegion[0] = x0; mRegion[1] = y0; mRegion[2] = z0;
+	mRegion[3] = x1; mRegion[4] = y1; mRegion[5] = z1;
+	mHasRegion = true;
+}
+
+void Mesher::removeRegion()
+{
+	mHasRegion = false;
+}
+
+void Mesher::setAmbientOcclusion(bool enable)
+{
+	mAmbientOcclusion = enable;
+}
+
+void Mesher::setParallel(bool enable)
+{
+	mParallel = enable;
+}
+
+template<class Func>
+void Mesher::forEachSlice(Func func)const
+{
+	if (mParallel)
+	{
+		parallelFor(0, mSlices.size(), func);
+		return;
+	}
+
+	for (size_t i = 0; i < mSlices.size(); ++i)
+		func(i);
+}
+
+void Mesher::setExterior(const BitGrid* exterior)
+{
+	mExterior = exterior;
+}
+
+int Mesher::getOcclusion(int face, int x, int y, int z)const
+{
+	const FaceInfo& info = FACES[face];
+
+	//the layer in front of the face
+	int p[3] = { x, y, z };
+	p[info.axis] += info.sign;
+
+	const int size[3] = { mGrid.getWidth(), mGrid.getHeight(), mGrid.getDepth() };
+	auto isFilled = [&](int du, int dv)
+	{
+		int q[3] = { p[0], p[1], p[2] };
+		q[info.u] += du;
+		q[info.v] += dv;
+		for (int i = 0; i < 3; ++i)
+		{
+			if (q[i] < 0 || q[i] >= size[i])
+				return 0;
+		}
+		return mGrid.get(q[0], q[1], q[2]) ? 1 : 0;
+	};
+
+	int ao = 0;
+	for (int cv = 0; cv < 2; ++cv)
+	{
+		for (int cu = 0; cu < 2; ++cu)
+		{
+			int du = cu ? 1 : -1;
+			int dv = cv ? 1 : -1;
+			int side1 = isFilled(du, 0);
+			int side2 = isFilled(0, dv);
+			int corner = isFilled(du, dv);
+			int value = side1 && side2 ? 0 : 3 - side1 - side2 - corner;
+			ao |= value << ((cu + cv * 2) * 2);
+		}
+	}
+	return ao;
+}
+
+void Mesher::clearOutput()
+{
+	mVertices.clear();
+	mPackedVertices.clear();
+	mIndexes.clear();
+	mShortIndexes.clear();
+}
+
+bool Mesher::buildSlices(const VoxelData& data)
+{
+	mSlices.clear();
+	mMeshes.clear();
+
+	if (data.width <= 0 || data.height <= 0 || data.depth <= 0)
+		return false;
+
+	assert(data.datas.size() >= (size_t)data.width * data.height * data.depth * sizeof(int));
+
+	//the bit grid covers the region plus one voxel around it, for the faces on the region border
+	const int size[3] = { data.width, data.height, data.depth };
+	int size3[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		int lo = mHasRegion ? std::max(mRegion[i], 0) : 0;
+		int hi = mHasRegion ? std::min(mRegion[i + 3], size[i]) : size[i];
+		if (lo >= hi)
+			return false;
+
+		mOrigin[i] = std::max(lo - 1, 0);
+		mMin[i] = lo - mOrigin[i];
+		mMax[i] = hi - mOrigin[i];
+		size3[i] = std::min(hi + 1, size[i]) - mOrigin[i];
+	}
+
+	mGrid.fromVoxels(data, mOrigin[0], mOrigin[1], mOrigin[2], size3[0], size3[1], size3[2]);
+	if (mExterior)
+	{
+		if (mExterior->getWidth() != data.width || mExterior->getHeight() != data.height || mExterior->getDepth() != data.depth)
+			EXCEPT("the exterior grid does not match the voxel data");
+		mExteriorBox.fromBits(*mExterior, mOrigin[0], mOrigin[1], mOrigin[2], size3[0], size3[1], size3[2]);
+	}
+	for (int face = 0; face < 6; ++face)
+		mGrid.getFaces((FaceDirection)face, mFaces[face], mExterior ? &mExteriorBox : NULL);
+
+	//one task per slice of every face direction
+	mSlices.reserve((mMax[0] - mMin[0] + mMax[1] - mMin[1] + mMax[2] - mMin[2]) * 2);
+	for (int face = 0; face < 6; ++face)
+	{
+		int axis = FACES[face].axis;
+		for (int i = mMin[axis]; i < mMax[axis]; ++i)
+		{
+			Slice slice = { face, i };
+			mSlices.push_back(slice);
+		}
+	}
+
+	//pass 1: the welded quads of every slice, counted in parallel
+	mMeshes.resize(mSlices.size());
+	const bool merge = mMode == MM_GREEDY;
+	forEachSlice([&](size_t i)
+	{
+		std::vector<Quad> quads;
+		meshSlice(data, mSlices[i], merge, quads);
+		weldSlice(mSlices[i].face, quads, mMeshes[i]);
+	});
+	return true;
+}
+
+void Mesher::getOffsets(std::vector<size_t>& vertices, std::vector<size_t>& indexes)const
+{
+	//pass 2: output offsets by prefix sum, then every slice writes its own range without locks
+	vertices.assign(mMeshes.size() + 1, 0);
+	indexes.assign(mMeshes.size() + 1, 0);
+	for (size_t i = 0; i < mMeshes.size(); ++i)
+	{
+		vertices[i + 1] = vertices[i] + mMeshes[i].corners.size();
+		indexes[i + 1] = indexes[i] + mMeshes[i].indexes.size();
+	}
+}
+
+void Mesher::getPosition(const Slice& slice, const Corner& corner, int position[3])const
+{
+	const FaceInfo& info = FACES[slice.face];
+	position[info.axis] = slice.index + mOrigin[info.axis] + (info.sign > 0 ? 1 : 0);
+	position[info.u] = corner.u;
+	position[info.v] = corner.v;
+}
+
+void Mesher::mesh(const VoxelData& data)
+{
+	clearOutput();
+	if (!buildSlices(data))
+		return;
+
+	std::vector<size_t> vertexOffsets, indexOffsets;
+	getOffsets(vertexOffsets, indexOffsets);
+
+	mVertices.resize(vertexOffsets.back());
+	mIndexes.resize(indexOffsets.back());
+	forEachSlice([&](size_t i)
+	{
+		const Slice& slice = mSlices[i];
+		const FaceInfo& info = FACES[slice.face];
+		const SliceMesh& mesh = mMeshes[i];
+
+		Vector3 normal = Vector3::ZERO;
+		(&normal.x)[info.axis] = (float)info.sign;
+
+		MeshVertex* vertices = mVertices.data() + vertexOffsets[i];
+		for (auto& c : mesh.corners)
+		{
+			int p[3];
+			getPosition(slice, c, p);
+			MeshVertex vert = { Vector3((float)p[0], (float)p[1], (float)p[2]), normal, c.color, c.ao };
+			*vertices++ = vert;
+		}
+
+		unsigned int base = (unsigned int)vertexOffsets[i];
+		unsigned int* indexes = mIndexes.data() + indexOffsets[i];
+		for (auto j : mesh.indexes)
+			*indexes++ = base + j;
+	});
+}
+
+void Mesher::meshPacked(const VoxelData& data, Palette& palette)
+{
+	clearOutput();
+	if (!buildSlices(data))
+		return;
+
+	for (int i = 0; i < 3; ++i)
+	{
+		if (mMax[i] - mMin[i] > 255)
+			EXCEPT("the region is too large for packed vertices");
+	}
+
+	//new colors go to the palette first, the parallel pass only reads it
+	int last = 0;
+	for (auto& mesh : mMeshes)
+	{
+		for (auto& c : mesh.corners)
+		{
+			if (c.color != last)
+			{
+				palette.addColor(c.color);
+				last = c.color;
+			}
+		}
+	}
+
+	std::vector<size_t> vertexOffsets, indexOffsets;
+	getOffsets(vertexOffsets, indexOffsets);
+
+	const bool shortIndexes = vertexOffsets.back() <= 0x10000;
+	mPackedVertices.resize(vertexOffsets.back());
+	if (shortIndexes)
+		mShortIndexes.resize(indexOffsets.back());
+	else
+		mIndexes.resize(indexOffsets.back());
+
+	forEachSlice([&](size_t i)
+	{
+		const Slice& slice = mSlices[i];
+		const SliceMesh& mesh = mMeshes[i];
+
+		PackedVertex* vertices = mPackedVertices.data() + vertexOffsets[i];
+		for (auto& c : mesh.corners)
+		{
+			int p[3];
+			getPosition(slice, c, p);
+			PackedVertex vert =
+			{
+				(unsigned char)(p[0] - mOrigin[0] - mMin[0]),
+				(unsigned char)(p[1] - mOrigin[1] - mMin[1]),
+				(unsigned char)(p[2] - mOrigin[2] - mMin[2]),
+				(unsigned char)slice.face,
+				palette.getIndex(c.color),
+				(unsigned char)c.ao,
+				0,
+			};
+			*vertices++ = vert;
+		}
+
+		unsigned int base = (unsigned int)vertexOffsets[i];
+		if (shortIndexes)
+		{
+			unsigned short* indexes = mShortIndexes.data() + indexOffsets[i];
+			for (auto j : mesh.indexes)
+				*indexes++ = (unsigned short)(base + j);
+		}
+		else
+		{
+			unsigned int* indexes = mIndexes.data() + indexOffsets[i];
+			for (auto j : mesh.indexes)
+				*indexes++ = base + j;
+		}
+	});
+}
+
+void Mesher::meshSlice(const VoxelData& data, const Slice& slice, bool merge, std::vector<Quad>& quads)const
+{
+	const FaceInfo& info = FACES[slice.face];
+	const int* voxels = (const int*)data.datas.data();
+	const int gridHeight = mGrid.getHeight();
+
+	const int du = mMax[info.u] - mMin[info.u];
+	const int dv = mMax[info.v] - mMin[info.v];
+
+	//visible faces as bits, 64 voxels along x per word
+	const std::vector<BitGrid::Word>& faces = mFaces[slice.face];
+	const int words = mGrid.getWordsPerRow();
+
+	//x, y, z are in bit grid coordinates. a face is its color in the low 32 bits and its occlusion in the high ones,
+	//so greedy merging only joins faces with the same occlusion
+	const bool occlusion = mAmbientOcclusion;
+	auto getFace = [&](int x, int y, int z)
+	{
+		unsigned int color = voxels[((size_t)(z + mOrigin[2]) * data.height + y + mOrigin[1]) * data.width + x + mOrigin[0]];
+		unsigned long long ao = occlusion ? getOcclusion(slice.face, x, y, z) : NO_OCCLUSION;
+		return color | (ao << 32);
+	};
+
+	//the visible faces in this slice, 0 where there is none
+	std::vector<unsigned long long> mask;
+	bool any = false;
+	if (info.axis == 0)
+	{
+		//the slice is one bit of every row
+		const int x = slice.index;
+		const int k = x >> 6;
+		const int bit = x & 63;
+		for (int z = mMin[2]; z < mMax[2]; ++z)
+		{
+			for (int y = mMin[1]; y < mMax[1]; ++y)
+			{
+				size_t row = (size_t)z * gridHeight + y;
+				if ((faces[row * words + k] >> bit) & 1)
+				{
+					if (!any)
+						mask.resize(du * dv, 0);
+					mask[(y - mMin[1]) + (z - mMin[2]) * du] = getFace(x, y, z);
+					any = true;
+				}
+			}
+		}
+	}
+	else
+	{
+		//the rows of the slice run along u = x, only the set bits are visited
+		for (int v = mMin[info.v]; v < mMax[info.v]; ++v)
+		{
+			int y = info.axis == 1 ? slice.index : v;
+			int z = info.axis == 1 ? v : slice.index;
+			const BitGrid::Word* bits = &faces[((size_t)z * gridHeight + y) * words];
+			for (int k = 0; k < words; ++k)
+			{
+				for (BitGrid::Word m = bits[k]; m != 0; m &= m - 1)
+				{
+					int x = k * BitGrid::WORD_BITS + BitGrid::ctz(m);
+					if (x < mMin[0] || x >= mMax[0])
+						continue;
+					if (!any)
+						mask.resize(du * dv, 0);
+					mask[(x - mMin[0]) + (v - mMin[info.v]) * du] = getFace(x, y, z);
+					any = true;
+				}
+			}
+		}
+	}
+
+	if (!any)
+		return;
+
+	const int offsetU = mMin[info.u] + mOrigin[info.u];
+	const int offsetV = mMin[info.v] + mOrigin[info.v];
+	for (int v = 0; v < dv; ++v)
+	{
+		for (int u = 0; u < du;)
+		{
+			unsigned long long face = mask[u + v * du];
+			if (face == 0)
+			{
+				++u;
+				continue;
+			}
+
+			//grow along u, then along v as long as the whole row matches
+			int w = 1;
+			int h = 1;
+			if (merge)
+			{
+				while (u + w < du && mask[u + w + v * du] == face)
+					++w;
+
+				for (; v + h < dv; ++h)
+				{
+					const unsigned long long* row = &mask[u + (v + h) * du];
+					int i = 0;
+					while (i < w && row[i] == face)
+						++i;
+					if (i != w)
+						break;
+				}
+
+				for (int j = 0; j < h; ++j)
+					std::fill(&mask[u + (v + j) * du], &mask[u + (v + j) * du] + w, 0);
+			}
+
+			Quad quad = { u + offsetU, v + offsetV, u + w + offsetU, v + h + offsetV, (int)(face & 0xffffffff), (int)(face >> 32) };
+			quads.push_back(quad);
+			u += w;
+		}
+	}
+}
+
+void Mesher::weldSlice(int face, const std::vector<Quad>& quads, SliceMesh& mesh)
+{
+	const FaceInfo& info = FACES[face];
+	const unsigned int indexSample[] =
+	{
+		0, 1, 2,
+		0, 2, 3,
+	};
+	//the other diagonal, for quads whose corners 1 and 3 are brighter than 0 and 2
+	const unsigned int flippedSample[] =
+	{
+		1, 2, 3,
+		1, 3, 0,
+	};
+
+	mesh.corners.clear();
+	mesh.indexes.clear();
+	mesh.corners.reserve(quads.size() * 2);
+	mesh.indexes.reserve(quads.size() * 6);
+
+	//everything but u, v, color and occlusion is the same in a slice, so they are the key
+	std::unordered_map<unsigned long long, unsigned int> welded;
+	welded.reserve(quads.size() * 2);
+	for (auto& q : quads)
+	{
+		unsigned int corners[4];
+		int ao[4];
+		for (int i = 0; i < 4; ++i)
+		{
+			int cu = info.corners[i][0];
+			int cv = info.corners[i][1];
+			ao[i] = (q.ao >> ((cu + cv * 2) * 2)) & 3;
+
+			Corner c = { cu ? q.u1 : q.u0, cv ? q.v1 : q.v0, q.color, ao[i] };
+			assert(c.u < 0x8000 && c.v < 0x8000);
+			unsigned int position = (unsigned int)c.u | ((unsigned int)c.v << 15) | ((unsigned int)c.ao << 30);
+			unsigned long long key = position | ((unsigned long long)(unsigned int)c.color << 32);
+			auto r = welded.insert(std::make_pair(key, (unsigned int)mesh.corners.size()));
+			if (r.second)
+				mesh.corners.push_back(c);
+			corners[i] = r.first->second;
+		}
+
+		//split along the brighter diagonal, otherwise the occlusion is interpolated unevenly across the quad
+		const unsigned int* sample = ao[0] + ao[2] < ao[1] + ao[3] ? flippedSample : indexSample;
+		for (int i = 0; i < 6; ++i)
+			mesh.indexes.push_back(corners[sample[i]]);
+	}
+}
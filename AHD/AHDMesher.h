@@ -0,0 +1,169 @@
+#ifndef _AHDMesher_H_
+#define _AHDMesher_H_
+
+#include "AHDUtils.h"
+#include "AHDBitGrid.h"
+#include <vector>
+#include <map>
+
+namespace AHD
+{
+	struct MeshVertex
+	{
+		Vector3 position;
+		Vector3 normal;
+		int color;
+		int ao;//ambient occlusion from 0 to 3, 3 is unoccluded
+	};
+
+	//8 byte vertex of the packed output: the position relative to the meshed region, the normal as a FaceDirection
+	//and the color as a Palette index
+	struct PackedVertex
+	{
+		unsigned char x, y, z;
+		unsigned char normal;
+		unsigned short color;
+		unsigned char ao;
+		unsigned char reserved;
+	};
+
+	//16 bit indexes for the 4 byte voxel colors of PackedVertex
+	class Palette
+	{
+	public:
+		//index of color, the color is added if it is new
+		unsigned short addColor(int color);
+		//index of a color that is already in the palette
+		unsigned short getIndex(int color)const;
+		int getColor(unsigned short index)const{ return mColors[index]; }
+
+		const std::vector<int>& getColors()const{ return mColors; }
+		size_t getSize()const{ return mColors.size(); }
+		void clear();
+
+	private:
+		std::vector<int> mColors;
+		std::map<int, unsigned short> mIndexes;
+	};
+
+	enum MeshMode
+	{
+		MM_CUBE,//one quad per visible voxel face
+		MM_GREEDY,//coplanar faces of the same color merged into maximal rectangles per slice
+	};
+
+	//builds an indexed triangle list of the faces between filled and empty voxels (the grid border counts as empty).
+	//voxels are 4 byte colors as exported by VoxelOutput, 0 is empty.
+	//corners shared by faces of the same slice and color are welded into one vertex
+	class Mesher
+	{
+	public:
+		void setMode(MeshMode mode);
+		MeshMode getMode()const{ return mMode; }
+
+		//only the voxels in [x0, x1) x [y0, y1) x [z0, z1) are meshed. faces against voxels outside of the
+		//region are still culled, so meshes of neighbouring regions fit together without gaps or doubles
+		void setRegion(int x0, int y0, int z0, int x1, int y1, int z1);
+		void removeRegion();
+
+		//per vertex ambient occlusion from the 3 voxels touching each corner in front of the face.
+		//greedy merging then only joins faces with the same occlusion. off by default
+		void setAmbientOcclusion(bool enable);
+		bool getAmbientOcclusion()const{ return mAmbientOcclusion; }
+
+		//with the exterior of the whole data (see BitGrid::getExterior), only faces against exterior voxels are meshed,
+		//the faces of sealed cavities are dropped. the grid is not copied and has to stay alive. NULL meshes all faces
+		void setExterior(const BitGrid* exterior);
+
+		//the slices of one mesh are split over the thread pool. turn it off for meshers that already run
+		//on a pool thread each, like the chunk meshers of VoxelWorld. on by default
+		void setParallel(bool enable);
+		bool getParallel()const{ return mParallel; }
+
+		//positions in voxel units of the whole grid, with voxel (x, y, z) covering [x, x + 1] and so on
+		void mesh(const VoxelData& data);
+		//PackedVertex output for chunks, positions relative to the region origin. new colors are added to palette.
+		//the region can be at most 255 voxels along every axis. indexes are 16 bit when the vertices fit
+		void meshPacked(const VoxelData& data, Palette& palette);
+
+		const std::vector<MeshVertex>& getVertices()const{ return mVertices; }
+		const std::vector<PackedVertex>& getPackedVertices()const{ return mPackedVertices; }
+		//32 bit indexes, empty when the 16 bit ones are used
+		const std::vector<unsigned int>& getIndexes()const{ return mIndexes; }
+		const std::vector<unsigned short>& getShortIndexes()const{ return mShortIndexes; }
+		bool hasShortIndexes()const{ return !mShortIndexes.empty(); }
+
+	private:
+		struct Slice
+		{
+			int face;
+			int index;
+		};
+
+		//a merged rectangle of faces in the (u, v) plane of a slice
+		struct Quad
+		{
+			int u0, v0, u1, v1;
+			int color;
+			//2 bits per corner in the order (u0, v0), (u1, v0), (u0, v1), (u1, v1)
+			int ao;
+		};
+
+		//a welded vertex of a slice
+		struct Corner
+		{
+			int u, v;
+			int color;
+			int ao;
+		};
+
+		//the output of one slice, indexes start at 0
+		struct SliceMesh
+		{
+			std::vector<Corner> corners;
+			std::vector<unsigned int> indexes;
+		};
+
+		//fills mSlices and mMeshes, returns false if the region is empty
+		bool buildSlices(const VoxelData& data);
+		void meshSlice(const VoxelData& data, const Slice& slice, bool merge, std::vector<Quad>& quads)const;
+		//occlusion of the face at (x, y, z) of the bit grid, in the layout of Quad::ao
+		int getOcclusion(int face, int x, int y, int z)const;
+		static void weldSlice(int face, const std::vector<Quad>& quads, SliceMesh& mesh);
+		//the position of corner in a slice, in voxel units of the whole grid
+		void getPosition(const Slice& slice, const Corner& corner, int position[3])const;
+		//vertex and index offsets of every slice, the totals are the last elements
+		void getOffsets(std::vector<size_t>& vertices, std::vector<size_t>& indexes)const;
+		void clearOutput();
+		//func(i) for every slice, over the thread pool when mParallel is set
+		template<class Func>
+		void forEachSlice(Func func)const;
+
+	private:
+		MeshMode mMode = MM_GREEDY;
+		bool mAmbientOcclusion = false;
+		bool mParallel = true;
+		const BitGrid* mExterior = NULL;
+
+		std::vector<MeshVertex> mVertices;
+		std::vector<PackedVertex> mPackedVertices;
+		std::vector<unsigned int> mIndexes;
+		std::vector<unsigned short> mShortIndexes;
+		int mRegion[6];
+		bool mHasRegion = false;
+
+		//the bit grid covers the region plus a border of one voxel. mOrigin is its position in the
+		//voxel data, [mMin, mMax) the region in bit grid coordinates
+		BitGrid mGrid;
+		BitGrid mExteriorBox;
+		std::vector<BitGrid::Word> mFaces[6];
+		int mOrigin[3];
+		int mMin[3];
+		int mMax[3];
+
+		std::vector<Slice> mSlices;
+		std::vector<SliceMesh> mMeshes;
+	};
+}
+
+#endif
@@ -0,0 +1,94 @@
+#include "AHDParallel.h"
+
+using namespace AHD;
+
+namespace
+{
+	std::once_flag poolOnce;
+	//never deleted, the threads wait for work until the process exits
+	ThreadPool* pool = nullptr;
+}
+
+void ParallelTask::work()
+{
+	try
+	{
+		for (size_t c = next++; c < chunks; c = next++)
+			runChunk(context, c);
+	}
+	catch (...)
+	{
+		std::lock_guard<std::mutex> lock(errorLock);
+		if (!error)
+			error = std::current_exception();
+		next = chunks;
+	}
+}
+
+ThreadPool& ThreadPool::getInstance()
+{
+	std::call_once(poolOnce, []()
+	{
+		pool = new ThreadPool();
+	});
+	return *pool;
+}
+
+ThreadPool::ThreadPool()
+{
+	const unsigned int threads = std::max(std::thread::hardware_concurrency(), 1u);
+	mThreads.reserve(threads - 1);
+	for (unsigned int i = 1; i < threads; ++i)
+	{
+		mThreads.push_back(std::thread([this]()
+		{
+			workerLoop();
+		}));
+		mThreads.back().detach();
+	}
+}
+
+void ThreadPool::run(ParallelTask& task, size_t helpers)
+{
+	{
+		std::lock_guard<std::mutex> lock(mLock);
+		for (size_t i = 0; i < helpers; ++i)
+			mQueue.push_back(&task);
+	}
+	if (helpers == 1)
+		mWork.notify_one();
+	else
+		mWork.notify_all();
+
+	task.work();
+
+	{
+		//helpers that have not started yet would find nothing left, they are taken back.
+		//the ones that started are counted in active and finish their last chunk
+		std::unique_lock<std::mutex> lock(mLock);
+		mQueue.erase(std::remove(mQueue.begin(), mQueue.end(), &task), mQueue.end());
+		mDone.wait(lock, [&task](){ return task.active == 0; });
+	}
+
+	if (task.error)
+		std::rethrow_exception(task.error);
+}
+
+void ThreadPool::workerLoop()
+{
+	std::unique_lock<std::mutex> lock(mLock);
+	for (;;)
+	{
+		mWork.wait(lock, [this](){ return !mQueue.empty(); });
+		ParallelTask* task = mQueue.front();
+		mQueue.pop_front();
+		++task->active;
+
+		lock.unlock();
+		task->work();
+		lock.lock();
+
+		if (--task->active == 0)
+			mDone.notify_all();
+	}
+}
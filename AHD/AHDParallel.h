@@ -0,0 +1,103 @@
+#ifndef _AHDParallel_H_
+#define _AHDParallel_H_
+
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <vector>
+#include <deque>
+#include <algorithm>
+
+namespace AHD
+{
+	//chunks of work shared by the calling thread and the pool threads that join it
+	struct ParallelTask
+	{
+		ParallelTask() : next(0), active(0){}
+
+		//runs the chunks until none is left. the first exception stops the remaining chunks and is kept
+		void work();
+
+		void (*runChunk)(void* context, size_t chunk);
+		void* context;
+		size_t chunks;
+		std::atomic<size_t> next;
+		//pool threads working on the task, changed under the pool lock
+		size_t active;
+		std::exception_ptr error;
+		std::mutex errorLock;
+	};
+
+	//one thread per hardware thread but the caller's, created on first use and kept until the process exits
+	class ThreadPool
+	{
+	public:
+		static ThreadPool& getInstance();
+
+		//the pool threads plus the calling thread
+		size_t getThreadCount()const{ return mThreads.size() + 1; }
+		//works on task with up to helpers pool threads, returns when every chunk is done.
+		//the caller works too and never waits for queued work, so tasks can be nested
+		void run(ParallelTask& task, size_t helpers);
+
+	private:
+		ThreadPool();
+		void workerLoop();
+
+	private:
+		std::vector<std::thread> mThreads;
+		std::deque<ParallelTask*> mQueue;
+		std::mutex mLock;
+		std::condition_variable mWork;
+		std::condition_variable mDone;
+	};
+
+	//calls func(i) for every i in [begin, end) from all hardware threads.
+	//work is handed out in chunks of grain indexes, the calling thread works too.
+	//the first exception thrown by func stops the remaining chunks and is rethrown here.
+	template<class Func>
+	void parallelFor(size_t begin, size_t end, Func func, size_t grain = 1)
+	{
+		if (end <= begin)
+			return;
+
+		grain = std::max(grain, (size_t)1);
+		const size_t chunks = (end - begin + grain - 1) / grain;
+
+		ThreadPool& pool = ThreadPool::getInstance();
+		const size_t threads = std::min(pool.getThreadCount(), chunks);
+		if (threads == 1)
+		{
+			for (size_t i = begin; i < end; ++i)
+				func(i);
+			return;
+		}
+
+		struct Context
+		{
+			Func* func;
+			size_t begin;
+			size_t end;
+			size_t grain;
+		};
+		Context context = { &func, begin, end, grain };
+
+		ParallelTask task;
+		task.runChunk = [](void* p, size_t chunk)
+		{
+			const Context& c = *(const Context*)p;
+			size_t b = c.begin + chunk * c.grain;
+			size_t e = std::min(b + c.grain, c.end);
+			for (size_t i = b; i < e; ++i)
+				(*c.func)(i);
+		};
+		task.context = &context;
+		task.chunks = chunks;
+
+		pool.run(task, threads - 1);
+	}
+}
+
+#endif
@@ -0,0 +1,256 @@
+#include "AHDQuery.h"
+#include "AHDParallel.h"
+#include <emmintrin.h>
+#include <algorithm>
+
+using namespace AHD;
+
+namespace
+{
+	//queries handed to a thread at once
+	const size_t QUERY_GRAIN = 1024;
+
+	//floor of 4 floats in the int range. values beyond it do not saturate: nan and large positive values
+	//become INT_MIN, large negative ones wrap around to INT_MAX. see clamp4
+	__m128i floor4(__m128 v)
+	{
+		__m128i t = _mm_cvttps_epi32(v);
+		//truncation rounds negative values up, the mask is -1 where it did
+		__m128 up = _mm_cmpgt_ps(_mm_cvtepi32_ps(t), v);
+		return _mm_add_epi32(t, _mm_castps_si128(up));
+	}
+
+	//clamps 4 floats to [-1e9, 1e9] for floor4, far outside of any grid and far from overflowing when a box
+	//adds 1 to its max corner. nan becomes 1e9, outside of the grid as well
+	__m128 clamp4(__m128 v)
+	{
+		return _mm_max_ps(_mm_min_ps(v, _mm_set1_ps(1e9f)), _mm_set1_ps(-1e9f));
+	}
+
+	//spreads the low 10 bits of every lane to every third bit
+	__m128i spread4(__m128i v)
+	{
+		v = _mm_and_si128(v, _mm_set1_epi32(0x3ff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 16)), _mm_set1_epi32(0x030000ff));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 8)), _mm_set1_epi32(0x0300f00f));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 4)), _mm_set1_epi32(0x030c30c3));
+		v = _mm_and_si128(_mm_or_si128(v, _mm_slli_epi32(v, 2)), _mm_set1_epi32(0x09249249));
+		return v;
+	}
+
+	//morton codes of 4 voxels, negative coordinates count as 0
+	__m128i morton4(__m128i x, __m128i y, __m128i z, int shift)
+	{
+		__m128i s = _mm_cvtsi32_si128(shift);
+		x = _mm_srl_epi32(_mm_andnot_si128(_mm_srai_epi32(x, 31), x), s);
+		y = _mm_srl_epi32(_mm_andnot_si128(_mm_srai_epi32(y, 31), y), s);
+		z = _mm_srl_epi32(_mm_andnot_si128(_mm_srai_epi32(z, 31), z), s);
+		return _mm_or_si128(spread4(x), _mm_or_si128(_mm_slli_epi32(spread4(y), 1), _mm_slli_epi32(spread4(z), 2)));
+	}
+}
+
+void OccupancyQuery::build(const BitGrid& grid)
+{
+	mGrid = grid;
+	mGrid.reduce(mLevels[0], LEVEL_SIZE);
+	mLevels[0].reduce(mLevels[1], LEVEL_SIZE);
+
+	const int size = std::max(std::max(grid.getWidth(), grid.getHeight()), grid.getDepth());
+	mShift = 0;
+	while (((size - 1) >> mShift) >= 1024)
+		++mShift;
+}
+
+void OccupancyQuery::build(const VoxelData& data)
+{
+	BitGrid grid;
+	grid.fromVoxels(data);
+	build(grid);
+}
+
+void OccupancyQuery::setVoxel(int x, int y, int z, bool filled)
+{
+	mGrid.set(x, y, z, filled);
+
+	//each level is filled if its block of the level below still has something
+	const BitGrid* below = &mGrid;
+	for (int i = 0; i < 2; ++i)
+	{
+		x /= LEVEL_SIZE;
+		y /= LEVEL_SIZE;
+		z /= LEVEL_SIZE;
+		const int x0 = x * LEVEL_SIZE;
+		const int y0 = y * LEVEL_SIZE;
+		const int z0 = z * LEVEL_SIZE;
+		mLevels[i].set(x, y, z, filled || below->any(x0, y0, z0, x0 + LEVEL_SIZE, y0 + LEVEL_SIZE, z0 + LEVEL_SIZE));
+		below = &mLevels[i];
+	}
+}
+
+bool OccupancyQuery::isFilled(int x, int y, int z)const
+{
+	if (x < 0 || y < 0 || z < 0 || x >= mGrid.getWidth() || y >= mGrid.getHeight() || z >= mGrid.getDepth())
+		return false;
+
+	//with LEVEL_SIZE 8 the levels are 3 and 6 bits coarser
+	return mLevels[1].get(x >> 6, y >> 6, z >> 6) &&
+		   mLevels[0].get(x >> 3, y >> 3, z >> 3) &&
+		   mGrid.get(x, y, z);
+}
+
+bool OccupancyQuery::isFilled(int x0, int y0, int z0, int x1, int y1, int z1)const
+{
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	z0 = std::max(z0, 0);
+	x1 = std::min(x1, mGrid.getWidth());
+	y1 = std::min(y1, mGrid.getHeight());
+	z1 = std::min(z1, mGrid.getDepth());
+	if (x0 >= x1 || y0 >= y1 || z0 >= z1)
+		return false;
+
+	if (x1 - x0 == 1 && y1 - y0 == 1 && z1 - z0 == 1)
+		return isFilled(x0, y0, z0);
+
+	//coarse levels first, the blocks of a level are the LEVEL_SIZE^3 blocks of the level below
+	for (int i = 1; i >= 0; --i)
+	{
+		const int shift = 3 * (i + 1);
+		if (!mLevels[i].any(x0 >> shift, y0 >> shift, z0 >> shift,
+			((x1 - 1) >> shift) + 1, ((y1 - 1) >> shift) + 1, ((z1 - 1) >> shift) + 1))
+			return false;
+	}
+
+	return mGrid.any(x0, y0, z0, x1, y1, z1);
+}
+
+void OccupancyQuery::queryPoints(const Vector3* points, size_t count, BitGrid::Word* results)const
+{
+	std::vector<int> boxes(count * 6);
+	std::vector<Query> queries(count);
+
+	//4 points at a time to voxels and morton codes
+	parallelFor(0, (count + 3) / 4, [&](size_t group)
+	{
+		const size_t first = group * 4;
+		const int lanes = (int)std::min((size_t)4, count - first);
+
+		float p[3][4];
+		for (int j = 0; j < 4; ++j)
+		{
+			const Vector3& v = points[first + (j < lanes ? j : 0)];
+			p[0][j] = v.x;
+			p[1][j] = v.y;
+			p[2][j] = v.z;
+		}
+
+		__m128i x = floor4(clamp4(_mm_loadu_ps(p[0])));
+		__m128i y = floor4(clamp4(_mm_loadu_ps(p[1])));
+		__m128i z = floor4(clamp4(_mm_loadu_ps(p[2])));
+
+		int v[3][4];
+		unsigned int codes[4];
+		_mm_storeu_si128((__m128i*)v[0], x);
+		_mm_storeu_si128((__m128i*)v[1], y);
+		_mm_storeu_si128((__m128i*)v[2], z);
+		_mm_storeu_si128((__m128i*)codes, morton4(x, y, z, mShift));
+
+		for (int j = 0; j < lanes; ++j)
+		{
+			const size_t i = first + j;
+			int* box = &boxes[i * 6];
+			box[0] = v[0][j];
+			box[1] = v[1][j];
+			box[2] = v[2][j];
+			//clamped, so the max corner cannot overflow
+			box[3] = v[0][j] + 1;
+			box[4] = v[1][j] + 1;
+			box[5] = v[2][j] + 1;
+			queries[i].code = codes[j];
+			queries[i].index = (unsigned int)i;
+		}
+	}, QUERY_GRAIN / 4);
+
+	run(boxes, queries, results);
+}
+
+void OccupancyQuery::queryBoxes(const AABB* aabbs, size_t count, BitGrid::Word* results)const
+{
+	std::vector<int> boxes(count * 6);
+	std::vector<Query> queries(count);
+
+	parallelFor(0, (count + 3) / 4, [&](size_t group)
+	{
+		const size_t first = group * 4;
+		const int lanes = (int)std::min((size_t)4, count - first);
+
+		float lo[3][4], hi[3][4];
+		for (int j = 0; j < 4; ++j)
+		{
+			const AABB& b = aabbs[first + (j < lanes ? j : 0)];
+			const Vector3& min = b.getMin();
+			const Vector3& max = b.getMax();
+			lo[0][j] = min.x; lo[1][j] = min.y; lo[2][j] = min.z;
+			hi[0][j] = max.x; hi[1][j] = max.y; hi[2][j] = max.z;
+		}
+
+		__m128i x = floor4(clamp4(_mm_loadu_ps(lo[0])));
+		__m128i y = floor4(clamp4(_mm_loadu_ps(lo[1])));
+		__m128i z = floor4(clamp4(_mm_loadu_ps(lo[2])));
+		//the closed box reaches into the voxel of its max corner
+		const __m128i one = _mm_set1_epi32(1);
+		int v[6][4];
+		unsigned int codes[4];
+		_mm_storeu_si128((__m128i*)v[0], x);
+		_mm_storeu_si128((__m128i*)v[1], y);
+		_mm_storeu_si128((__m128i*)v[2], z);
+		_mm_storeu_si128((__m128i*)v[3], _mm_add_epi32(floor4(clamp4(_mm_loadu_ps(hi[0]))), one));
+		_mm_storeu_si128((__m128i*)v[4], _mm_add_epi32(floor4(clamp4(_mm_loadu_ps(hi[1]))), one));
+		_mm_storeu_si128((__m128i*)v[5], _mm_add_epi32(floor4(clamp4(_mm_loadu_ps(hi[2]))), one));
+		_mm_storeu_si128((__m128i*)codes, morton4(x, y, z, mShift));
+
+		for (int j = 0; j < lanes; ++j)
+		{
+			const size_t i = first + j;
+			int* box = &boxes[i * 6];
+			const bool valid = aabbs[i].isValid();
+			for (int k = 0; k < 6; ++k)
+				box[k] = valid ? v[k][j] : 0;
+			queries[i].code = codes[j];
+			queries[i].index = (unsigned int)i;
+		}
+	}, QUERY_GRAIN / 4);
+
+	run(boxes, queries, results);
+}
+
+void OccupancyQuery::run(const std::vector<int>& boxes, std::vector<Query>& queries, BitGrid::Word* results)const
+{
+	const size_t count = queries.size();
+	std::sort(queries.begin(), queries.end(), [](const Query& a, const Query& b)
+	{
+		return a.code < b.code;
+	});
+
+	//the keys are made 4 at a time with SSE, the answers are scalar: in morton order, neighbouring queries
+	//read the same level words, which stay in cache.
+	//one byte per query, threads answering neighbours in morton order may share a result word
+	std::vector<unsigned char> hits(count);
+	parallelFor(0, count, [&](size_t i)
+	{
+		const unsigned int index = queries[i].index;
+		const int* b = &boxes[(size_t)index * 6];
+		hits[index] = isFilled(b[0], b[1], b[2], b[3], b[4], b[5]) ? 1 : 0;
+	}, QUERY_GRAIN);
+
+	const size_t words = (count + BitGrid::WORD_BITS - 1) / BitGrid::WORD_BITS;
+	parallelFor(0, words, [&](size_t k)
+	{
+		const size_t begin = k * BitGrid::WORD_BITS;
+		const size_t end = std::min(begin + BitGrid::WORD_BITS, count);
+		BitGrid::Word w = 0;
+		for (size_t i = begin; i < end; ++i)
+			w |= (BitGrid::Word)hits[i] << (i - begin);
+		results[k] = w;
+	}, QUERY_GRAIN / BitGrid::WORD_BITS);
+}
@@ -0,0 +1,53 @@
+#ifndef _AHDQuery_H_
+#define _AHDQuery_H_
+
+#include "AHDUtils.h"
+#include "AHDBitGrid.h"
+#include <vector>
+
+namespace AHD
+{
+	//batched occupancy tests against a voxel grid, in voxel units as RayCaster: point p is in voxel floor(p),
+	//a box touches every voxel its closed extent overlaps. the queries are answered in morton order of their
+	//voxels, and blocks of 8^3 and 64^3 voxels without anything in them answer without touching the voxels.
+	//results are bits, bit i % 64 of word i / 64 for query i, with (count + 63) / 64 words provided by the caller
+	class OccupancyQuery
+	{
+	public:
+		static const int LEVEL_SIZE = 8;
+
+		void build(const BitGrid& grid);
+		void build(const VoxelData& data);
+		//keeps the grid up to date with an edit
+		void setVoxel(int x, int y, int z, bool filled);
+
+		bool isFilled(int x, int y, int z)const;
+		//whether a voxel of [x0, x1) x [y0, y1) x [z0, z1) is filled
+		bool isFilled(int x0, int y0, int z0, int x1, int y1, int z1)const;
+
+		//points inside a filled voxel
+		void queryPoints(const Vector3* points, size_t count, BitGrid::Word* results)const;
+		//boxes touching a filled voxel, invalid boxes touch nothing
+		void queryBoxes(const AABB* aabbs, size_t count, BitGrid::Word* results)const;
+
+	private:
+		//the voxel boxes of the queries in morton order of their first voxel
+		struct Query
+		{
+			unsigned int code;
+			unsigned int index;
+		};
+
+		//answers the queries, box i is boxes[6 * i] to boxes[6 * i + 5] as in isFilled
+		void run(const std::vector<int>& boxes, std::vector<Query>& queries, BitGrid::Word* results)const;
+
+	private:
+		BitGrid mGrid;
+		//mLevels[0] has a voxel per LEVEL_SIZE^3 voxels of mGrid, mLevels[1] one per LEVEL_SIZE^3 of mLevels[0]
+		BitGrid mLevels[2];
+		//right shift of the voxel coordinates so that they fit in the 10 bits per axis of a morton code
+		int mShift = 0;
+	};
+}
+
+#endif
@@ -0,0 +1,284 @@
+#include "AHDRayCast.h"
+#include "AHDParallel.h"
+#include <xmmintrin.h>
+#include <algorithm>
+#include <limits>
+#include <math.h>
+
+using namespace AHD;
+
+namespace
+{
+	const float INF = std::numeric_limits<float>::infinity();
+
+	//dda state: the current cell of size voxels, and per axis the direction, the distance to the next
+	//boundary and the distance between boundaries
+	struct Walker
+	{
+		int cell[3];
+		int step[3];
+		float next[3];
+		float delta[3];
+
+		void init(const float origin[3], const float direction[3], const float point[3], const int lo[3], const int hi[3], int size)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				int v = (int)floorf(point[i]);
+				v = std::min(std::max(v, lo[i]), hi[i] - 1);
+				cell[i] = v / size;
+				if (direction[i] > 0)
+				{
+					step[i] = 1;
+					next[i] = ((cell[i] + 1) * size - origin[i]) / direction[i];
+					delta[i] = size / direction[i];
+				}
+				else if (direction[i] < 0)
+				{
+					step[i] = -1;
+					next[i] = (cell[i] * size - origin[i]) / direction[i];
+					delta[i] = -size / direction[i];
+				}
+				else
+				{
+					step[i] = 0;
+					next[i] = INF;
+					delta[i] = INF;
+				}
+			}
+		}
+
+		int getNextAxis()const
+		{
+			if (next[0] < next[1])
+				return next[0] < next[2] ? 0 : 2;
+			return next[1] < next[2] ? 1 : 2;
+		}
+	};
+
+	int getFace(int axis, int step)
+	{
+		if (axis < 0)
+			return -1;
+		//stepping along +x enters the voxel through its -x face
+		return step > 0 ? FD_NEGATIVE_X + axis : FD_POSITIVE_X + axis;
+	}
+}
+
+void RayCaster::build(const BitGrid& grid)
+{
+	mGrid = grid;
+	mSize[0] = grid.getWidth();
+	mSize[1] = grid.getHeight();
+	mSize[2] = grid.getDepth();
+
+	grid.reduce(mBricks, BRICK_SIZE);
+}
+
+void RayCaster::build(const VoxelData& data)
+{
+	BitGrid grid;
+	grid.fromVoxels(data);
+	build(grid);
+}
+
+void RayCaster::setVoxel(int x, int y, int z, bool filled)
+{
+	assert(x >= 0 && x < mSize[0] && y >= 0 && y < mSize[1] && z >= 0 && z < mSize[2]);
+	mGrid.set(x, y, z, filled);
+
+	const int bx = x / BRICK_SIZE;
+	const int by = y / BRICK_SIZE;
+	const int bz = z / BRICK_SIZE;
+	const int x0 = bx * BRICK_SIZE;
+	const int y0 = by * BRICK_SIZE;
+	const int z0 = bz * BRICK_SIZE;
+	mBricks.set(bx, by, bz, filled || mGrid.any(x0, y0, z0, x0 + BRICK_SIZE, y0 + BRICK_SIZE, z0 + BRICK_SIZE));
+}
+
+bool RayCaster::cast(const Ray& ray, RayHit& hit)const
+{
+	hit.hit = false;
+
+	const float origin[3] = { ray.origin.x, ray.origin.y, ray.origin.z };
+	const float direction[3] = { ray.direction.x, ray.direction.y, ray.direction.z };
+
+	//entry and exit of the grid box
+	float t0 = 0;
+	float t1 = ray.maxDistance;
+	int axis = -1;
+	for (int i = 0; i < 3; ++i)
+	{
+		if (direction[i] == 0)
+		{
+			if (origin[i] < 0 || origin[i] >= mSize[i])
+				return false;
+			continue;
+		}
+
+		float a = (0 - origin[i]) / direction[i];
+		float b = (mSize[i] - origin[i]) / direction[i];
+		if (a > b)
+			std::swap(a, b);
+		if (a > t0)
+		{
+			t0 = a;
+			axis = i;
+		}
+		t1 = std::min(t1, b);
+	}
+
+	if (t0 > t1)
+		return false;
+
+	return traverse(origin, direction, t0, t1, axis, hit);
+}
+
+void RayCaster::cast(const Ray* rays, size_t count, RayHit* hits)const
+{
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 one = _mm_set1_ps(1.0f);
+	const __m128 inf = _mm_set1_ps(INF);
+
+	//packets of 4 rays, the grid entry is found for the 4 at once and each one walks on its own
+	const size_t packets = (count + 3) / 4;
+	parallelFor(0, packets, [&](size_t packet)
+	{
+		const size_t first = packet * 4;
+		const int lanes = (int)std::min((size_t)4, count - first);
+
+		//transposed into one register per component, missing lanes repeat the first ray
+		float o[3][4], d[3][4], m[4];
+		for (int j = 0; j < 4; ++j)
+		{
+			const Ray& r = rays[first + (j < lanes ? j : 0)];
+			o[0][j] = r.origin.x; o[1][j] = r.origin.y; o[2][j] = r.origin.z;
+			d[0][j] = r.direction.x; d[1][j] = r.direction.y; d[2][j] = r.direction.z;
+			m[j] = r.maxDistance;
+		}
+
+		__m128 t0 = zero;
+		__m128 t1 = _mm_loadu_ps(m);
+		__m128 axis = _mm_set1_ps(-1.0f);
+		for (int i = 0; i < 3; ++i)
+		{
+			__m128 org = _mm_loadu_ps(o[i]);
+			__m128 dir = _mm_loadu_ps(d[i]);
+			__m128 size = _mm_set1_ps((float)mSize[i]);
+			__m128 inv = _mm_div_ps(one, dir);
+			__m128 a = _mm_mul_ps(_mm_sub_ps(zero, org), inv);
+			__m128 b = _mm_mul_ps(_mm_sub_ps(size, org), inv);
+			__m128 lo = _mm_min_ps(a, b);
+			__m128 hi = _mm_max_ps(a, b);
+
+			//rays parallel to the slabs are in for all t or out for all t
+			__m128 parallel = _mm_cmpeq_ps(dir, zero);
+			__m128 inside = _mm_and_ps(_mm_cmpge_ps(org, zero), _mm_cmplt_ps(org, size));
+			__m128 parallelLo = _mm_or_ps(_mm_and_ps(inside, _mm_sub_ps(zero, inf)), _mm_andnot_ps(inside, inf));
+			__m128 parallelHi = _mm_or_ps(_mm_and_ps(inside, inf), _mm_andnot_ps(inside, _mm_sub_ps(zero, inf)));
+			lo = _mm_or_ps(_mm_and_ps(parallel, parallelLo), _mm_andnot_ps(parallel, lo));
+			hi = _mm_or_ps(_mm_and_ps(parallel, parallelHi), _mm_andnot_ps(parallel, hi));
+
+			__m128 later = _mm_cmpgt_ps(lo, t0);
+			axis = _mm_or_ps(_mm_and_ps(later, _mm_set1_ps((float)i)), _mm_andnot_ps(later, axis));
+			t0 = _mm_max_ps(t0, lo);
+			t1 = _mm_min_ps(t1, hi);
+		}
+
+		float enter[4], leave[4], axes[4];
+		_mm_storeu_ps(enter, t0);
+		_mm_storeu_ps(leave, t1);
+		_mm_storeu_ps(axes, axis);
+		for (int j = 0; j < lanes; ++j)
+		{
+			RayHit& hit = hits[first + j];
+			hit.hit = false;
+			if (enter[j] > leave[j])
+				continue;
+
+			const float origin[3] = { o[0][j], o[1][j], o[2][j] };
+			const float direction[3] = { d[0][j], d[1][j], d[2][j] };
+			traverse(origin, direction, enter[j], leave[j], (int)axes[j], hit);
+		}
+	}, 16);
+}
+
+bool RayCaster::traverse(const float origin[3], const float direction[3], float t0, float t1, int axis, RayHit& hit)const
+{
+	const int zero[3] = { 0, 0, 0 };
+	const int bricks[3] = { mBricks.getWidth(), mBricks.getHeight(), mBricks.getDepth() };
+	const float point[3] =
+	{
+		origin[0] + direction[0] * t0,
+		origin[1] + direction[1] * t0,
+		origin[2] + direction[2] * t0,
+	};
+
+	Walker walker;
+	walker.init(origin, direction, point, zero, mSize, BRICK_SIZE);
+
+	float t = t0;
+	for (;;)
+	{
+		if (mBricks.get(walker.cell[0], walker.cell[1], walker.cell[2]) &&
+			traverseBrick(origin, direction, t, t1, axis, walker.cell, hit))
+			return true;
+
+		int i = walker.getNextAxis();
+		if (walker.next[i] > t1)
+			return false;
+
+		t = walker.next[i];
+		axis = i;
+		walker.cell[i] += walker.step[i];
+		if (walker.cell[i] < 0 || walker.cell[i] >= bricks[i])
+			return false;
+		walker.next[i] += walker.delta[i];
+	}
+}
+
+bool RayCaster::traverseBrick(const float origin[3], const float direction[3], float t, float t1, int axis, const int brick[3], RayHit& hit)const
+{
+	int lo[3], hi[3];
+	for (int i = 0; i < 3; ++i)
+	{
+		lo[i] = brick[i] * BRICK_SIZE;
+		hi[i] = std::min(lo[i] + BRICK_SIZE, mSize[i]);
+	}
+
+	const float point[3] =
+	{
+		origin[0] + direction[0] * t,
+		origin[1] + direction[1] * t,
+		origin[2] + direction[2] * t,
+	};
+
+	Walker walker;
+	walker.init(origin, direction, point, lo, hi, 1);
+
+	for (;;)
+	{
+		const int* v = walker.cell;
+		if (mGrid.get(v[0], v[1], v[2]))
+		{
+			hit.hit = true;
+			hit.voxel[0] = v[0];
+			hit.voxel[1] = v[1];
+			hit.voxel[2] = v[2];
+			hit.face = axis < 0 ? -1 : getFace(axis, walker.step[axis]);
+			hit.distance = t;
+			return true;
+		}
+
+		int i = walker.getNextAxis();
+		if (walker.next[i] > t1)
+			return false;
+
+		t = walker.next[i];
+		axis = i;
+		walker.cell[i] += walker.step[i];
+		if (walker.cell[i] < lo[i] || walker.cell[i] >= hi[i])
+			return false;
+		walker.next[i] += walker.delta[i];
+	}
+}
@@ -0,0 +1,57 @@
+#ifndef _AHDRayCast_H_
+#define _AHDRayCast_H_
+
+#include "AHDUtils.h"
+#include "AHDBitGrid.h"
+#include <vector>
+
+namespace AHD
+{
+	//in voxel units, voxel (x, y, z) covers [x, x + 1] and so on
+	struct Ray
+	{
+		Vector3 origin;
+		//does not need to be normalized, distances are in units of its length
+		Vector3 direction;
+		float maxDistance;
+	};
+
+	struct RayHit
+	{
+		bool hit;
+		int voxel[3];
+		//the FaceDirection of the face the ray entered the voxel through, -1 if it starts inside the voxel
+		int face;
+		float distance;
+	};
+
+	//ray queries against a voxel grid by 3d dda. bricks of BRICK_SIZE^3 voxels without anything in them
+	//are skipped in one step, the voxels are only walked inside filled bricks
+	class RayCaster
+	{
+	public:
+		static const int BRICK_SIZE = 8;
+
+		void build(const BitGrid& grid);
+		void build(const VoxelData& data);
+		//keeps the grid up to date with an edit
+		void setVoxel(int x, int y, int z, bool filled);
+
+		//the first filled voxel along the ray within its max distance
+		bool cast(const Ray& ray, RayHit& hit)const;
+		//many rays in parallel, with the grid entry of 4 rays at once
+		void cast(const Ray* rays, size_t count, RayHit* hits)const;
+
+	private:
+		//walks from distance t0 to t1, axis is the axis the ray entered the grid through or -1
+		bool traverse(const float origin[3], const float direction[3], float t0, float t1, int axis, RayHit& hit)const;
+		bool traverseBrick(const float origin[3], const float direction[3], float t, float t1, int axis, const int brick[3], RayHit& hit)const;
+
+	private:
+		BitGrid mGrid;
+		BitGrid mBricks;
+		int mSize[3] = { 0, 0, 0 };
+	};
+}
+
+#endif
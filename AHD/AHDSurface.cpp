@@ -0,0 +1,370 @@
+#include "AHDSurface.h"
+#include "AHDParallel.h"
+#include <emmintrin.h>
+#include <algorithm>
+#include <math.h>
+
+using namespace AHD;
+
+namespace
+{
+	const float ISO_LEVEL = 0.5f;
+	const unsigned int NO_VERTEX = 0xffffffff;
+
+	//the 12 cell edges as corner pairs, 4 along every axis
+	const int EDGES[12][2] =
+	{
+		{ 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 },
+		{ 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 },
+		{ 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 },
+	};
+
+	//the edges crossed by the surface for every corner mask
+	struct EdgeTable
+	{
+		unsigned short edges[256];
+
+		EdgeTable()
+		{
+			for (int mask = 0; mask < 256; ++mask)
+			{
+				edges[mask] = 0;
+				for (int i = 0; i < 12; ++i)
+				{
+					if (((mask >> EDGES[i][0]) & 1) != ((mask >> EDGES[i][1]) & 1))
+						edges[mask] |= 1 << i;
+				}
+			}
+		}
+	};
+
+	const EdgeTable EDGE_TABLE;
+}
+
+void SurfaceNets::setSmoothing(int passes)
+{
+	mSmoothing = std::max(passes, 0);
+}
+
+void SurfaceNets::extract(const VoxelData& data)
+{
+	mVertices.clear();
+	mIndexes.clear();
+
+	if (data.width <= 0 || data.height <= 0 || data.depth <= 0)
+	{
+		mDensity.clear();
+		return;
+	}
+
+	assert(data.datas.size() >= (size_t)data.width * data.height * data.depth * sizeof(int));
+
+	buildDensity(data);
+	buildCells();
+	buildVertices(data);
+	buildQuads();
+}
+
+void SurfaceNets::buildDensity(const VoxelData& data)
+{
+	mSize[0] = data.width + 2;
+	mSize[1] = data.height + 2;
+	mSize[2] = data.depth + 2;
+
+	const size_t sliceSize = (size_t)mSize[0] * mSize[1];
+	mDensity.assign(sliceSize * mSize[2], 0.0f);
+
+	const int* voxels = (const int*)data.datas.data();
+	parallelFor(0, data.depth, [&](size_t z)
+	{
+		for (int y = 0; y < data.height; ++y)
+		{
+			const int* src = voxels + ((size_t)z * data.height + y) * data.width;
+			float* dst = &mDensity[(z + 1) * sliceSize + (y + 1) * mSize[0] + 1];
+			for (int x = 0; x < data.width; ++x)
+				dst[x] = src[x] != 0 ? 1.0f : 0.0f;
+		}
+	});
+
+	//the blur only writes inside the border, so the border stays empty and the surface stays closed
+	std::vector<float> temp(mSmoothing > 0 ? mDensity.size() : 0, 0.0f);
+	const size_t steps[3] = { 1, (size_t)mSize[0], sliceSize };
+	for (int pass = 0; pass < mSmoothing; ++pass)
+	{
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			const size_t step = steps[axis];
+			const std::vector<float>& src = mDensity;
+			parallelFor(1, mSize[2] - 1, [&](size_t z)
+			{
+				for (int y = 1; y < mSize[1] - 1; ++y)
+				{
+					size_t row = z * sliceSize + y * mSize[0];
+					for (int x = 1; x < mSize[0] - 1; ++x)
+					{
+						size_t i = row + x;
+						temp[i] = (src[i - step] + src[i] * 2.0f + src[i + step]) * 0.25f;
+					}
+				}
+			});
+			mDensity.swap(temp);
+		}
+	}
+
+	//inside flags, 16 samples per batch
+	mInside.resize(mDensity.size() + 32);
+	const size_t count = mDensity.size();
+	const __m128 iso = _mm_set1_ps(ISO_LEVEL);
+	const __m128i one = _mm_set1_epi8(1);
+	parallelFor(0, (count + 4095) / 4096, [&](size_t block)
+	{
+		size_t begin = block * 4096;
+		size_t end = std::min(begin + 4096, count);
+		size_t i = begin;
+		for (; i + 16 <= end; i += 16)
+		{
+			const float* d = &mDensity[i];
+			__m128i a = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(d), iso));
+			__m128i b = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(d + 4), iso));
+			__m128i c = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(d + 8), iso));
+			__m128i e = _mm_castps_si128(_mm_cmpgt_ps(_mm_loadu_ps(d + 12), iso));
+			__m128i flags = _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, e));
+			_mm_storeu_si128((__m128i*)&mInside[i], _mm_and_si128(flags, one));
+		}
+		for (; i < end; ++i)
+			mInside[i] = mDensity[i] > ISO_LEVEL ? 1 : 0;
+	});
+	std::fill(mInside.begin() + count, mInside.end(), 0);
+}
+
+void SurfaceNets::buildCells()
+{
+	for (int i = 0; i < 3; ++i)
+		mCells[i] = mSize[i] - 1;
+
+	const size_t sliceSize = (size_t)mSize[0] * mSize[1];
+	mMasks.resize((size_t)mCells[0] * mCells[1] * mCells[2]);
+
+	//masks of 16 cells at once: the 8 corner flags are bytes of 0 or 1, shifted in from corner 7 down to corner 0
+	parallelFor(0, mCells[2], [&](size_t z)
+	{
+		for (int y = 0; y < mCells[1]; ++y)
+		{
+			const unsigned char* r00 = &mInside[z * sliceSize + y * mSize[0]];
+			const unsigned char* r10 = r00 + mSize[0];
+			const unsigned char* r01 = r00 + sliceSize;
+			const unsigned char* r11 = r01 + mSize[0];
+			unsigned char* out = &mMasks[(z * mCells[1] + y) * mCells[0]];
+
+			for (int x = 0; x < mCells[0]; x += 16)
+			{
+				const unsigned char* corners[8] =
+				{
+					r00 + x, r00 + x + 1, r10 + x, r10 + x + 1,
+					r01 + x, r01 + x + 1, r11 + x, r11 + x + 1,
+				};
+
+				__m128i mask = _mm_loadu_si128((const __m128i*)corners[7]);
+				for (int i = 6; i >= 0; --i)
+					mask = _mm_add_epi8(_mm_add_epi8(mask, mask), _mm_loadu_si128((const __m128i*)corners[i]));
+
+				int n = std::min(16, mCells[0] - x);
+				if (n == 16)
+					_mm_storeu_si128((__m128i*)(out + x), mask);
+				else
+				{
+					unsigned char temp[16];
+					_mm_storeu_si128((__m128i*)temp, mask);
+					std::copy(temp, temp + n, out + x);
+				}
+			}
+		}
+	});
+}
+
+void SurfaceNets::buildVertices(const VoxelData& data)
+{
+	const size_t sliceSize = (size_t)mSize[0] * mSize[1];
+	const size_t cellSlice = (size_t)mCells[0] * mCells[1];
+	mCellVertex.resize(mMasks.size());
+
+	//count the vertices of every layer, the prefix sum gives each layer its own output range
+	mVertexOffsets.assign(mCells[2] + 1, 0);
+	parallelFor(0, mCells[2], [&](size_t z)
+	{
+		const unsigned char* masks = &mMasks[z * cellSlice];
+		size_t n = 0;
+		for (size_t i = 0; i < cellSlice; ++i)
+			n += masks[i] != 0 && masks[i] != 255;
+		mVertexOffsets[z + 1] = n;
+	});
+	for (int z = 0; z < mCells[2]; ++z)
+		mVertexOffsets[z + 1] += mVertexOffsets[z];
+
+	mVertices.resize(mVertexOffsets.back());
+
+	const int* voxels = (const int*)data.datas.data();
+	parallelFor(0, mCells[2], [&](size_t z)
+	{
+		size_t vertex = mVertexOffsets[z];
+		for (int y = 0; y < mCells[1]; ++y)
+		{
+			for (int x = 0; x < mCells[0]; ++x)
+			{
+				size_t cell = z * cellSlice + (size_t)y * mCells[0] + x;
+				int mask = mMasks[cell];
+				if (mask == 0 || mask == 255)
+				{
+					mCellVertex[cell] = NO_VERTEX;
+					continue;
+				}
+
+				float d[8];
+				for (int i = 0; i < 8; ++i)
+					d[i] = mDensity[(z + (i >> 2)) * sliceSize + (y + ((i >> 1) & 1)) * mSize[0] + x + (i & 1)];
+
+				//average of the crossings of the edges in the table
+				float p[3] = { 0, 0, 0 };
+				int crossings = 0;
+				for (int e = 0, edges = EDGE_TABLE.edges[mask]; edges != 0; ++e, edges >>= 1)
+				{
+					if ((edges & 1) == 0)
+						continue;
+
+					int a = EDGES[e][0];
+					int b = EDGES[e][1];
+					float t = (ISO_LEVEL - d[a]) / (d[b] - d[a]);
+					for (int axis = 0; axis < 3; ++axis)
+					{
+						float ca = (float)((a >> axis) & 1);
+						float cb = (float)((b >> axis) & 1);
+						p[axis] += ca + (cb - ca) * t;
+					}
+					++crossings;
+				}
+
+				//sample (x, y, z) is the center of voxel (x - 1, y - 1, z - 1)
+				const float base[3] = { x - 0.5f, y - 0.5f, z - 0.5f };
+				for (int axis = 0; axis < 3; ++axis)
+					p[axis] = base[axis] + p[axis] / crossings;
+
+				//the density grows inwards, the normal points the other way
+				float n[3] =
+				{
+					(d[0] + d[2] + d[4] + d[6]) - (d[1] + d[3] + d[5] + d[7]),
+					(d[0] + d[1] + d[4] + d[5]) - (d[2] + d[3] + d[6] + d[7]),
+					(d[0] + d[1] + d[2] + d[3]) - (d[4] + d[5] + d[6] + d[7]),
+				};
+				float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+				if (length > 0)
+				{
+					n[0] /= length;
+					n[1] /= length;
+					n[2] /= length;
+				}
+
+				//color of the filled corner voxel with the highest density, 0 if the corners are all empty voxels
+				int color = 0;
+				float best = -1.0f;
+				for (int i = 0; i < 8; ++i)
+				{
+					int vx = x + (i & 1) - 1;
+					int vy = y + ((i >> 1) & 1) - 1;
+					int vz = (int)z + (i >> 2) - 1;
+					if (vx < 0 || vx >= data.width || vy < 0 || vy >= data.height || vz < 0 || vz >= data.depth)
+						continue;
+
+					int c = voxels[((size_t)vz * data.height + vy) * data.width + vx];
+					if (c != 0 && d[i] > best)
+					{
+						color = c;
+						best = d[i];
+					}
+				}
+
+				MeshVertex vert = { Vector3(p[0], p[1], p[2]), Vector3(n[0], n[1], n[2]), color, 3 };
+				mVertices[vertex] = vert;
+				mCellVertex[cell] = (unsigned int)vertex;
+				++vertex;
+			}
+		}
+	});
+}
+
+void SurfaceNets::buildQuads()
+{
+	const size_t cellSlice = (size_t)mCells[0] * mCells[1];
+	const size_t steps[3] = { 1, (size_t)mCells[0], cellSlice };
+
+	//every edge from corner 0 of a cell along x, y or z that the surface crosses gives a quad through the
+	//vertices of the 4 cells around the edge. edges on the border never cross, so those cells always exist
+	auto getQuadAxes = [&](int x, int y, size_t z, int mask)
+	{
+		int axes = 0;
+		const int c[3] = { x, y, (int)z };
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if ((mask & 1) != ((mask >> (1 << axis)) & 1) && c[(axis + 1) % 3] > 0 && c[(axis + 2) % 3] > 0)
+				axes |= 1 << axis;
+		}
+		return axes;
+	};
+
+	mQuadOffsets.assign(mCells[2] + 1, 0);
+	parallelFor(0, mCells[2], [&](size_t z)
+	{
+		size_t n = 0;
+		for (int y = 0; y < mCells[1]; ++y)
+		{
+			const unsigned char* masks = &mMasks[z * cellSlice + (size_t)y * mCells[0]];
+			for (int x = 0; x < mCells[0]; ++x)
+			{
+				if (masks[x] != 0 && masks[x] != 255)
+				{
+					int axes = getQuadAxes(x, y, z, masks[x]);
+					n += (axes & 1) + ((axes >> 1) & 1) + ((axes >> 2) & 1);
+				}
+			}
+		}
+		mQuadOffsets[z + 1] = n;
+	});
+	for (int z = 0; z < mCells[2]; ++z)
+		mQuadOffsets[z + 1] += mQuadOffsets[z];
+
+	mIndexes.resize(mQuadOffsets.back() * 6);
+	parallelFor(0, mCells[2], [&](size_t z)
+	{
+		unsigned int* out = mIndexes.data() + mQuadOffsets[z] * 6;
+		for (int y = 0; y < mCells[1]; ++y)
+		{
+			for (int x = 0; x < mCells[0]; ++x)
+			{
+				size_t cell = z * cellSlice + (size_t)y * mCells[0] + x;
+				int mask = mMasks[cell];
+				if (mask == 0 || mask == 255)
+					continue;
+
+				int axes = getQuadAxes(x, y, z, mask);
+				for (int axis = 0; axis < 3; ++axis)
+				{
+					if ((axes & (1 << axis)) == 0)
+						continue;
+
+					size_t u = steps[(axis + 1) % 3];
+					size_t v = steps[(axis + 2) % 3];
+					unsigned int quad[4] =
+					{
+						mCellVertex[cell], mCellVertex[cell - u], mCellVertex[cell - u - v], mCellVertex[cell - v],
+					};
+					//same winding as the mesher: the quad faces away from the inside corner
+					if (mask & 1)
+						std::swap(quad[1], quad[3]);
+
+					out[0] = quad[0]; out[1] = quad[1]; out[2] = quad[2];
+					out[3] = quad[0]; out[4] = quad[2]; out[5] = quad[3];
+					out += 6;
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,61 @@
+#ifndef _AHDSurface_H_
+#define _AHDSurface_H_
+
+#include "AHDUtils.h"
+#include "AHDMesher.h"
+#include <vector>
+
+namespace AHD
+{
+	//smooth isosurface of the voxels by surface nets.
+	//the density is 1 for filled voxels and 0 for empty ones, sampled at the voxel centers, optionally blurred,
+	//and the surface is where it crosses 0.5. every cell between 8 samples that the surface passes through gets one
+	//vertex, shared by all the quads around it, so the output is welded.
+	//positions are in voxel units like the output of Mesher, the grid border counts as empty so the surface is closed
+	class SurfaceNets
+	{
+	public:
+		//passes of a 1-2-1 blur along every axis over the density before extraction, 0 keeps the hard voxel density
+		void setSmoothing(int passes);
+		int getSmoothing()const{ return mSmoothing; }
+
+		void extract(const VoxelData& data);
+
+		const std::vector<MeshVertex>& getVertices()const{ return mVertices; }
+		const std::vector<unsigned int>& getIndexes()const{ return mIndexes; }
+
+		//the density of the last extract, with a border of one sample around the grid:
+		//sample (x, y, z) is the center of voxel (x - 1, y - 1, z - 1), at ((z * (height + 2) + y) * (width + 2) + x)
+		const std::vector<float>& getDensity()const{ return mDensity; }
+
+	private:
+		void buildDensity(const VoxelData& data);
+		void buildCells();
+		void buildVertices(const VoxelData& data);
+		void buildQuads();
+
+	private:
+		int mSmoothing = 0;
+
+		std::vector<MeshVertex> mVertices;
+		std::vector<unsigned int> mIndexes;
+
+		//samples, with the border
+		int mSize[3];
+		std::vector<float> mDensity;
+		//1 where the density is inside the surface, padded for 16 byte loads past the end
+		std::vector<unsigned char> mInside;
+
+		//cells between the samples, one less along every axis
+		int mCells[3];
+		//bit i is the inside flag of the corner (i & 1, (i >> 1) & 1, (i >> 2) & 1) of the cell
+		std::vector<unsigned char> mMasks;
+		//vertex of every cell that the surface passes through
+		std::vector<unsigned int> mCellVertex;
+		//vertices and quads of every layer of cells along z
+		std::vector<size_t> mVertexOffsets;
+		std::vector<size_t> mQuadOffsets;
+	};
+}
+
+#endif
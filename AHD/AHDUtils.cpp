@@ -1,4 +1,8 @@
 #include "AHDUtils.h"
+#include "AHDParallel.h"
+#include <xmmintrin.h>
+#include <vector>
+#include <algorithm>
 
 using namespace AHD;
 
@@ -10,4 +14,124 @@ const Vector3 Vector3::UNIT_Z(0, 0, 1);
 const Vector3 Vector3::NEGATIVE_UNIT_X(-1, 0, 0);
 const Vector3 Vector3::NEGATIVE_UNIT_Y(0, -1, 0);
 const Vector3 Vector3::NEGATIVE_UNIT_Z(0, 0, -1);
-const Vector3 Vector3::UNIT_SCALE(1, 1, 1);
\ No newline at end of file
+const Vector3 Vector3::UNIT_SCALE(1, 1, 1);
+
+
+//xyz into the low 3 lanes without reading past the position, w repeats x so it never widens the box
+static inline __m128 loadPosition(const char* p)
+{
+	__m128 xy = _mm_loadl_pi(_mm_setzero_ps(), (const __m64*)p);
+	__m128 z = _mm_load_ss((const float*)p + 2);
+	__m128 xyz = _mm_movelh_ps(xy, z);
+	return _mm_shuffle_ps(xyz, xyz, _MM_SHUFFLE(0, 2, 1, 0));
+}
+
+static void boundsRange(const char* begin, size_t count, size_t stride, __m128& outMin, __m128& outMax)
+{
+	//4 independent accumulators hide the min/max latency
+	__m128 min0 = loadPosition(begin);
+	__m128 max0 = min0;
+	__m128 min1 = min0, max1 = min0, min2 = min0, max2 = min0, min3 = min0, max3 = min0;
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const char* p = begin + i * stride;
+		__m128 v0 = loadPosition(p);
+		__m128 v1 = loadPosition(p + stride);
+		__m128 v2 = loadPosition(p + stride * 2);
+		__m128 v3 = loadPosition(p + stride * 3);
+		min0 = _mm_min_ps(min0, v0); max0 = _mm_max_ps(max0, v0);
+		min1 = _mm_min_ps(min1, v1); max1 = _mm_max_ps(max1, v1);
+		min2 = _mm_min_ps(min2, v2); max2 = _mm_max_ps(max2, v2);
+		min3 = _mm_min_ps(min3, v3); max3 = _mm_max_ps(max3, v3);
+	}
+	for (; i < count; ++i)
+	{
+		__m128 v = loadPosition(begin + i * stride);
+		min0 = _mm_min_ps(min0, v);
+		max0 = _mm_max_ps(max0, v);
+	}
+
+	outMin = _mm_min_ps(_mm_min_ps(min0, min1), _mm_min_ps(min2, min3));
+	outMax = _mm_max_ps(_mm_max_ps(max0, max1), _mm_max_ps(max2, max3));
+}
+
+AABB AHD::computeBounds(const void* vertices, size_t count, size_t stride, size_t posoffset)
+{
+	AABB aabb;
+	if (vertices == nullptr || count == 0)
+		return aabb;
+
+	const char* begin = (const char*)vertices + posoffset;
+
+	//below this a single thread is faster than waking the others
+	const size_t CHUNK = BOUNDS_CHUNK_VERTICES;
+	const size_t chunks = (count + CHUNK - 1) / CHUNK;
+
+	__m128 min, max;
+	if (chunks == 1)
+	{
+		boundsRange(begin, count, stride, min, max);
+	}
+	else
+	{
+		struct Range
+		{
+			float min[4];
+			float max[4];
+		};
+		std::vector<Range> ranges(chunks);
+		parallelFor(0, chunks, [&](size_t c)
+		{
+			size_t first = c * CHUNK;
+			__m128 cmin, cmax;
+			boundsRange(begin + first * stride, std::min(CHUNK, count - first), stride, cmin, cmax);
+			_mm_storeu_ps(ranges[c].min, cmin);
+			_mm_storeu_ps(ranges[c].max, cmax);
+		});
+
+		min = _mm_loadu_ps(ranges[0].min);
+		max = _mm_loadu_ps(ranges[0].max);
+		for (size_t c = 1; c < chunks; ++c)
+		{
+			min = _mm_min_ps(min, _mm_loadu_ps(ranges[c].min));
+			max = _mm_max_ps(max, _mm_loadu_ps(ranges[c].max));
+		}
+	}
+
+	float fmin[4], fmax[4];
+	_mm_storeu_ps(fmin, min);
+	_mm_storeu_ps(fmax, max);
+	aabb.setExtents(Vector3(fmin[0], fmin[1], fmin[2]), Vector3(fmax[0], fmax[1], fmax[2]));
+	return aabb;
+}
+
+void AHD::quantizePositions(short* out, const float* positions, size_t count, Vector3& scale, Vector3& offset)
+{
+	AABB aabb = computeBounds(positions, count, sizeof(float) * 3);
+	if (!aabb.isValid())
+	{
+		scale = Vector3::UNIT_SCALE;
+		offset = Vector3::ZERO;
+		return;
+	}
+
+	offset = aabb.getCenter();
+	Vector3 half = aabb.getSize() * 0.5f;
+	//flat axes still need a scale that can be divided by
+	scale = Vector3(half.x > 0 ? half.x : 1, half.y > 0 ? half.y : 1, half.z > 0 ? half.z : 1);
+
+	const float inv[3] = { 32767.0f / scale.x, 32767.0f / scale.y, 32767.0f / scale.z };
+	const float center[3] = { offset.x, offset.y, offset.z };
+	for (size_t i = 0; i < count; ++i)
+	{
+		for (int j = 0; j < 3; ++j)
+		{
+			float q = (positions[i * 3 + j] - center[j]) * inv[j];
+			q = std::max(-32767.0f, std::min(32767.0f, q));
+			out[i * 4 + j] = (short)(q < 0 ? q - 0.5f : q + 0.5f);
+		}
+		out[i * 4 + 3] = 0;
+	}
+}
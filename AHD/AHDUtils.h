@@ -2,6 +2,8 @@
 #define _AHDUtils_H_
 
 #include <assert.h>
+#include <stddef.h>
+#include <vector>
 
 namespace AHD
 {
@@ -194,11 +196,42 @@ namespace AHD
 			mType = T_INVALID;
 		}
 
+		//closed boxes, touching counts. invalid boxes intersect nothing
+		inline bool intersects(const AABB& rhs)const
+		{
+			if (!isValid() || !rhs.isValid())
+				return false;
+
+			return mMin.x <= rhs.mMax.x && rhs.mMin.x <= mMax.x &&
+				   mMin.y <= rhs.mMax.y && rhs.mMin.y <= mMax.y &&
+				   mMin.z <= rhs.mMax.z && rhs.mMin.z <= mMax.z;
+		}
+
 	private:
 		Vector3 mMin;
 		Vector3 mMax;
 		Type mType = T_INVALID;
 	};
+
+	//voxels as exported by VoxelOutput, width * height * depth elements with x running fastest
+	struct VoxelData
+	{
+		std::vector<char> datas;
+		int width = 0;
+		int height = 0;
+		int depth = 0;
+	};
+
+	//computeBounds splits arrays of more vertices than this over threads
+	const size_t BOUNDS_CHUNK_VERTICES = 1 << 20;
+
+	//bounds of count positions (3 floats at posoffset) that are stride bytes apart.
+	//sse min/max over 4 vertices per step, very large arrays are split over threads
+	AABB computeBounds(const void* vertices, size_t count, size_t stride, size_t posoffset = 0);
+
+	//quantizes count float3 positions into 4 shorts each (w = 0) for VoxelResource::setVertexQuantized.
+	//scale and offset receive the decode, the error is at most half of scale / 32767 per axis
+	void quantizePositions(short* out, const float* positions, size_t count, Vector3& scale, Vector3& offset);
 }
 
 #endif
\ No newline at end of file
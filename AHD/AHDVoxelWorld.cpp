@@ -0,0 +1,348 @@
+#include "AHDVoxelWorld.h"
+#include "AHDParallel.h"
+#include <algorithm>
+#include <queue>
+
+using namespace AHD;
+
+namespace
+{
+	const int NEIGHBOURS[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+
+	//more edits than one per this many voxels find the whole exterior again
+	const size_t FULL_EXTERIOR_RATIO = 256;
+}
+
+void VoxelWorld::create(int width, int height, int depth)
+{
+	mVoxels.width = std::max(width, 0);
+	mVoxels.height = std::max(height, 0);
+	mVoxels.depth = std::max(depth, 0);
+	mVoxels.datas.assign((size_t)mVoxels.width * mVoxels.height * mVoxels.depth * sizeof(int), 0);
+	createChunks();
+}
+
+void VoxelWorld::fromVoxels(const VoxelData& data)
+{
+	assert(data.datas.size() >= (size_t)data.width * data.height * data.depth * sizeof(int));
+
+	mVoxels = data;
+	createChunks();
+}
+
+void VoxelWorld::createChunks()
+{
+	const int size[3] = { mVoxels.width, mVoxels.height, mVoxels.depth };
+	for (int i = 0; i < 3; ++i)
+		mChunkCount[i] = (size[i] + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	mChunks.clear();
+	mChunks.resize((size_t)mChunkCount[0] * mChunkCount[1] * mChunkCount[2]);
+	mPalette.clear();
+
+	mExterior.resize(0, 0, 0);
+	mSearched.resize(0, 0, 0);
+	mExteriorDirty = true;
+	mEdits.clear();
+}
+
+void VoxelWorld::setExteriorOnly(bool enable)
+{
+	if (enable == mExteriorOnly)
+		return;
+
+	mExteriorOnly = enable;
+	for (auto& i : mChunks)
+		i.dirty = true;
+}
+
+void VoxelWorld::getChunkOrigin(int chunk, int origin[3])const
+{
+	origin[0] = chunk % mChunkCount[0] * CHUNK_SIZE;
+	origin[1] = chunk / mChunkCount[0] % mChunkCount[1] * CHUNK_SIZE;
+	origin[2] = chunk / (mChunkCount[0] * mChunkCount[1]) * CHUNK_SIZE;
+}
+
+int VoxelWorld::get(int x, int y, int z)const
+{
+	assert(x >= 0 && x < mVoxels.width && y >= 0 && y < mVoxels.height && z >= 0 && z < mVoxels.depth);
+	return ((const int*)mVoxels.datas.data())[((size_t)z * mVoxels.height + y) * mVoxels.width + x];
+}
+
+void VoxelWorld::set(int x, int y, int z, int color)
+{
+	assert(x >= 0 && x < mVoxels.width && y >= 0 && y < mVoxels.height && z >= 0 && z < mVoxels.depth);
+	int& voxel = ((int*)mVoxels.datas.data())[((size_t)z * mVoxels.height + y) * mVoxels.width + x];
+	if (voxel == color)
+		return;
+
+	//only filling or clearing a voxel changes the exterior, a new color does not
+	if ((voxel == 0) != (color == 0))
+	{
+		if (!mExteriorOnly)
+			mExteriorDirty = true;
+		else if (!mExteriorDirty)
+		{
+			Voxel v = { x, y, z };
+			mEdits.push_back(v);
+		}
+	}
+	voxel = color;
+
+	//a voxel on a chunk border changes the culled faces and the occlusion of the neighbour chunks
+	setDirtyAround(x, y, z);
+}
+
+void VoxelWorld::setDirty(int x, int y, int z)
+{
+	if (x < 0 || x >= mVoxels.width || y < 0 || y >= mVoxels.height || z < 0 || z >= mVoxels.depth)
+		return;
+
+	mChunks[getChunk(x / CHUNK_SIZE, y / CHUNK_SIZE, z / CHUNK_SIZE)].dirty = true;
+}
+
+void VoxelWorld::setDirtyAround(int x, int y, int z)
+{
+	//setDirty ignores voxels outside of the grid
+	for (int dz = -1; dz <= 1; ++dz)
+	{
+		for (int dy = -1; dy <= 1; ++dy)
+		{
+			for (int dx = -1; dx <= 1; ++dx)
+				setDirty(x + dx, y + dy, z + dz);
+		}
+	}
+}
+
+int VoxelWorld::getBorderDistance(const Voxel& v)const
+{
+	int d = std::min(std::min(v.x, mVoxels.width - 1 - v.x), std::min(v.y, mVoxels.height - 1 - v.y));
+	return std::min(d, std::min(v.z, mVoxels.depth - 1 - v.z));
+}
+
+void VoxelWorld::findExterior()
+{
+	BitGrid grid;
+	grid.fromVoxels(mVoxels);
+	BitGrid exterior;
+	grid.getExterior(exterior);
+
+	//a voxel that became exterior or stopped being one changes the faces of its neighbours
+	if (mExterior.getWidth() == exterior.getWidth() && mExterior.getHeight() == exterior.getHeight() &&
+		mExterior.getDepth() == exterior.getDepth())
+	{
+		const int words = exterior.getWordsPerRow();
+		for (int z = 0; z < mVoxels.depth; ++z)
+		{
+			for (int y = 0; y < mVoxels.height; ++y)
+			{
+				const BitGrid::Word* a = mExterior.getRow(y, z);
+				const BitGrid::Word* b = exterior.getRow(y, z);
+				for (int k = 0; k < words; ++k)
+				{
+					for (BitGrid::Word diff = a[k] ^ b[k]; diff != 0; diff &= diff - 1)
+					{
+						setDirtyAround(k * BitGrid::WORD_BITS + BitGrid::ctz(diff), y, z);
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		for (auto& i : mChunks)
+			i.dirty = true;
+	}
+
+	mExterior = exterior;
+	mSearched.resize(mVoxels.width, mVoxels.height, mVoxels.depth);
+	mExteriorDirty = false;
+	mEdits.clear();
+}
+
+void VoxelWorld::updateExterior()
+{
+	const size_t volume = (size_t)mVoxels.width * mVoxels.height * mVoxels.depth;
+	if (mExteriorDirty || mEdits.size() > volume / FULL_EXTERIOR_RATIO)
+	{
+		findExterior();
+		return;
+	}
+
+	//filled voxels leave the exterior first, so it only holds empty voxels while it grows
+	for (auto& v : mEdits)
+	{
+		if (!isEmpty(v) && mExterior.get(v.x, v.y, v.z))
+		{
+			mExterior.set(v.x, v.y, v.z, false);
+			setDirtyAround(v.x, v.y, v.z);
+		}
+	}
+
+	//cleared voxels on the border or next to the exterior join it, with the empty voxels they opened up
+	for (auto& v : mEdits)
+	{
+		if (!isEmpty(v) || mExterior.get(v.x, v.y, v.z))
+			continue;
+
+		bool exterior = getBorderDistance(v) == 0;
+		for (int i = 0; i < 6 && !exterior; ++i)
+			exterior = mExterior.get(v.x + NEIGHBOURS[i][0], v.y + NEIGHBOURS[i][1], v.z + NEIGHBOURS[i][2]);
+		if (exterior)
+			growExterior(v);
+	}
+
+	//the exterior is now made of whole empty regions, the ones next to filled voxels may be cut off from the border
+	for (auto& v : mEdits)
+	{
+		if (isEmpty(v))
+			continue;
+
+		for (int i = 0; i < 6; ++i)
+		{
+			Voxel n = { v.x + NEIGHBOURS[i][0], v.y + NEIGHBOURS[i][1], v.z + NEIGHBOURS[i][2] };
+			if (n.x >= 0 && n.x < mVoxels.width && n.y >= 0 && n.y < mVoxels.height && n.z >= 0 && n.z < mVoxels.depth &&
+				mExterior.get(n.x, n.y, n.z))
+				checkExterior(n);
+		}
+	}
+
+	mEdits.clear();
+}
+
+void VoxelWorld::growExterior(const Voxel& seed)
+{
+	std::vector<Voxel> stack(1, seed);
+	mExterior.set(seed.x, seed.y, seed.z, true);
+	setDirtyAround(seed.x, seed.y, seed.z);
+	while (!stack.empty())
+	{
+		Voxel v = stack.back();
+		stack.pop_back();
+		for (int i = 0; i < 6; ++i)
+		{
+			Voxel n = { v.x + NEIGHBOURS[i][0], v.y + NEIGHBOURS[i][1], v.z + NEIGHBOURS[i][2] };
+			if (n.x < 0 || n.x >= mVoxels.width || n.y < 0 || n.y >= mVoxels.height || n.z < 0 || n.z >= mVoxels.depth ||
+				!isEmpty(n) || mExterior.get(n.x, n.y, n.z))
+				continue;
+
+			mExterior.set(n.x, n.y, n.z, true);
+			setDirtyAround(n.x, n.y, n.z);
+			stack.push_back(n);
+		}
+	}
+}
+
+void VoxelWorld::checkExterior(const Voxel& start)
+{
+	struct Step
+	{
+		int distance;
+		Voxel voxel;
+		//the queue puts the largest first
+		bool operator<(const Step& rhs)const{ return distance > rhs.distance; }
+	};
+
+	//in open space the search goes straight to the border, only a sealed region is searched completely
+	std::vector<Voxel> searched(1, start);
+	std::priority_queue<Step> queue;
+	Step first = { getBorderDistance(start), start };
+	queue.push(first);
+	mSearched.set(start.x, start.y, start.z, true);
+	bool border = false;
+	while (!queue.empty())
+	{
+		Step step = queue.top();
+		queue.pop();
+		if (step.distance == 0)
+		{
+			border = true;
+			break;
+		}
+
+		//not on the border, so the neighbours are inside of the grid
+		for (int i = 0; i < 6; ++i)
+		{
+			const Voxel& v = step.voxel;
+			Voxel n = { v.x + NEIGHBOURS[i][0], v.y + NEIGHBOURS[i][1], v.z + NEIGHBOURS[i][2] };
+			if (!mExterior.get(n.x, n.y, n.z) || mSearched.get(n.x, n.y, n.z))
+				continue;
+
+			mSearched.set(n.x, n.y, n.z, true);
+			searched.push_back(n);
+			Step next = { getBorderDistance(n), n };
+			queue.push(next);
+		}
+	}
+
+	for (auto& v : searched)
+	{
+		mSearched.set(v.x, v.y, v.z, false);
+		if (!border)
+		{
+			mExterior.set(v.x, v.y, v.z, false);
+			setDirtyAround(v.x, v.y, v.z);
+		}
+	}
+}
+
+int VoxelWorld::update(const Mesher& mesher)
+{
+	if (mExteriorOnly && (mExteriorDirty || !mEdits.empty()))
+		updateExterior();
+
+	std::vector<int> dirty;
+	for (int i = 0; i < (int)mChunks.size(); ++i)
+	{
+		if (mChunks[i].dirty)
+			dirty.push_back(i);
+	}
+	if (dirty.empty())
+		return 0;
+
+	//one serial mesher per thread, each takes the next dirty chunk until none is left.
+	//a single chunk is meshed by one mesher that splits its slices over the pool instead
+	const size_t workers = std::min(ThreadPool::getInstance().getThreadCount(), dirty.size());
+	std::atomic<size_t> next(0);
+	std::mutex paletteLock;
+	parallelFor(0, workers, [&](size_t)
+	{
+		Mesher worker;
+		worker.setMode(mesher.getMode());
+		worker.setAmbientOcclusion(mesher.getAmbientOcclusion());
+		worker.setExterior(mExteriorOnly ? &mExterior : NULL);
+		worker.setParallel(workers == 1);
+
+		//the colors are collected in a palette of the thread, and only its new ones are added to the shared one
+		Palette palette;
+		std::vector<unsigned short> colors;
+		for (size_t i = next++; i < dirty.size(); i = next++)
+		{
+			const int c = dirty[i];
+			int origin[3];
+			getChunkOrigin(c, origin);
+
+			//the mesher clamps the region to the grid
+			worker.setRegion(origin[0], origin[1], origin[2],
+							 origin[0] + CHUNK_SIZE, origin[1] + CHUNK_SIZE, origin[2] + CHUNK_SIZE);
+			worker.meshPacked(mVoxels, palette);
+
+			if (colors.size() < palette.getSize())
+			{
+				std::lock_guard<std::mutex> lock(paletteLock);
+				for (size_t j = colors.size(); j < palette.getSize(); ++j)
+					colors.push_back(mPalette.addColor(palette.getColor((unsigned short)j)));
+			}
+
+			Chunk& chunk = mChunks[c];
+			chunk.vertices = worker.getPackedVertices();
+			for (auto& v : chunk.vertices)
+				v.color = colors[v.color];
+			chunk.indexes = worker.getIndexes();
+			chunk.shortIndexes = worker.getShortIndexes();
+			chunk.dirty = false;
+		}
+	});
+
+	return (int)dirty.size();
+}
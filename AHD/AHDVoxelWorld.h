@@ -0,0 +1,110 @@
+#ifndef _AHDVoxelWorld_H_
+#define _AHDVoxelWorld_H_
+
+#include "AHDUtils.h"
+#include "AHDMesher.h"
+#include <vector>
+
+namespace AHD
+{
+	//editable voxel grid, split into chunks of CHUNK_SIZE^3 voxels that are meshed separately.
+	//edits mark the chunks they touch as dirty, update() only re-meshes those.
+	//chunk meshes are packed, with positions relative to getChunkOrigin and colors in the palette of the world
+	class VoxelWorld
+	{
+	public:
+		static const int CHUNK_SIZE = 32;
+
+		//an empty world, every chunk dirty
+		void create(int width, int height, int depth);
+		//copies the voxels of data, every chunk dirty
+		void fromVoxels(const VoxelData& data);
+
+		int getWidth()const{ return mVoxels.width; }
+		int getHeight()const{ return mVoxels.height; }
+		int getDepth()const{ return mVoxels.depth; }
+		const VoxelData& getVoxels()const{ return mVoxels; }
+
+		int get(int x, int y, int z)const;
+		//0 clears the voxel
+		void set(int x, int y, int z, int color);
+		void clear(int x, int y, int z){ set(x, y, z, 0); }
+
+		int getChunkCountX()const{ return mChunkCount[0]; }
+		int getChunkCountY()const{ return mChunkCount[1]; }
+		int getChunkCountZ()const{ return mChunkCount[2]; }
+		int getChunkCount()const{ return (int)mChunks.size(); }
+		//chunk index of chunk (cx, cy, cz)
+		int getChunk(int cx, int cy, int cz)const{ return (cz * mChunkCount[1] + cy) * mChunkCount[0] + cx; }
+		//the voxel of the chunk at position (0, 0, 0)
+		void getChunkOrigin(int chunk, int origin[3])const;
+
+		bool isDirty(int chunk)const{ return mChunks[chunk].dirty; }
+		void setDirty(int chunk){ mChunks[chunk].dirty = true; }
+		//only mesh faces that can be seen from outside of the grid, see Mesher::setExterior.
+		//update() keeps the exterior up to date around the edits, chunks where it changed are re-meshed
+		void setExteriorOnly(bool enable);
+		bool getExteriorOnly()const{ return mExteriorOnly; }
+
+		//re-meshes the dirty chunks with the mode and ambient occlusion of mesher, returns how many were re-meshed.
+		//the chunks are meshed in parallel by meshers of its own, mesher is not changed
+		int update(const Mesher& mesher);
+
+		//colors of all the chunks, it only grows until the world is created again
+		const Palette& getPalette()const{ return mPalette; }
+
+		const std::vector<PackedVertex>& getVertices(int chunk)const{ return mChunks[chunk].vertices; }
+		//one of the two is empty, the 16 bit indexes are used when the vertices fit
+		const std::vector<unsigned int>& getIndexes(int chunk)const{ return mChunks[chunk].indexes; }
+		const std::vector<unsigned short>& getShortIndexes(int chunk)const{ return mChunks[chunk].shortIndexes; }
+
+	private:
+		struct Chunk
+		{
+			bool dirty = true;
+			std::vector<PackedVertex> vertices;
+			std::vector<unsigned int> indexes;
+			std::vector<unsigned short> shortIndexes;
+		};
+
+		struct Voxel
+		{
+			int x, y, z;
+		};
+
+		void createChunks();
+		//marks the chunk of voxel (x, y, z), ignores voxels outside of the grid
+		void setDirty(int x, int y, int z);
+		//marks the chunks of the voxels around (x, y, z), diagonal ones included
+		void setDirtyAround(int x, int y, int z);
+		bool isEmpty(const Voxel& v)const{ return get(v.x, v.y, v.z) == 0; }
+		//voxels away from the grid border
+		int getBorderDistance(const Voxel& v)const;
+
+		//finds the exterior of all the voxels, marks the chunks around the voxels whose exterior state changed
+		void findExterior();
+		//updates the exterior around the voxels in mEdits, or finds it again when that is cheaper
+		void updateExterior();
+		//adds the empty voxels connected to seed to the exterior
+		void growExterior(const Voxel& seed);
+		//searches the exterior voxels connected to start for the grid border, closest to the border first.
+		//if the border is not found they were sealed by the edits and leave the exterior
+		void checkExterior(const Voxel& start);
+
+	private:
+		VoxelData mVoxels;
+		int mChunkCount[3] = { 0, 0, 0 };
+		std::vector<Chunk> mChunks;
+		Palette mPalette;
+
+		bool mExteriorOnly = false;
+		//the exterior has to be found again, mEdits are the voxels that were cleared or filled since it was updated
+		bool mExteriorDirty = true;
+		std::vector<Voxel> mEdits;
+		BitGrid mExterior;
+		//voxels of the current checkExterior search
+		BitGrid mSearched;
+	};
+}
+
+#endif
@@ -9,7 +9,8 @@ HRESULT D3D11Helper::createDevice(ID3D11Device** mDevice, ID3D11DeviceContext**
 		NULL,
 		D3D_DRIVER_TYPE_HARDWARE,
 		NULL,
-		D3D11_CREATE_DEVICE_SINGLETHREADED
+		//not single threaded, resources may be created from worker threads
+		0
 #ifdef _DEBUG
 		| D3D11_CREATE_DEVICE_DEBUG
 #endif
@@ -177,3 +178,14 @@ HRESULT D3D11Helper::createBuffer(ID3D11Buffer** buffer, ID3D11Device* mDevice,
 	InitData.pSysMem = initdata;
 	return mDevice->CreateBuffer(&bd, initdata ? &InitData : 0, buffer);
 }
+
+HRESULT D3D11Helper::createDynamicBuffer(ID3D11Buffer** buffer, ID3D11Device* mDevice, D3D11_BIND_FLAG flag, size_t size)
+{
+	D3D11_BUFFER_DESC bd;
+	ZeroMemory(&bd, sizeof(bd));
+	bd.Usage = D3D11_USAGE_DYNAMIC;
+	bd.ByteWidth = size;
+	bd.BindFlags = flag;
+	bd.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+	return mDevice->CreateBuffer(&bd, 0, buffer);
+}
@@ -32,7 +32,8 @@ struct PS_INPUT
 PS_INPUT vs(VS_INPUT input)
 {
 	PS_INPUT output;// = (PS_INPUT)0;
-	output.Pos = mul(input.Pos, World);
+	//snorm16 positions have w = 0
+	output.Pos = mul(float4(input.Pos.xyz, 1), World);
 	output.Pos = mul(output.Pos, View);
 	output.Pos = mul(output.Pos, Projection);
 	
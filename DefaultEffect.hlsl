@@ -14,7 +14,7 @@ RWTexture3D<unsigned int> voxels:register(u1);
 
 struct VS_INPUT
 {
-	float4 Pos : POSITION;
+	float3 Pos : POSITION;
 
 };
 
@@ -27,7 +27,7 @@ struct PS_INPUT
 PS_INPUT vs(VS_INPUT input)
 {
 	PS_INPUT output;// = (PS_INPUT)0;
-	output.Pos = mul(input.Pos, World);
+	output.Pos = mul(float4(input.Pos, 1), World);
 	output.Pos = mul(output.Pos, View);
 	output.Pos = mul(output.Pos, Projection);
 	
@@ -51,12 +51,19 @@ public:
 			D3D11_INPUT_ELEMENT_DESC desc[] =
 			{
 				{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+			};
+			//quantized positions, the decode is part of the world matrix
+			D3D11_INPUT_ELEMENT_DESC descSnorm16[] =
+			{
+				{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 			};
 
 			ID3DBlob* blob;
 			AHD::D3D11Helper::compileShader(&blob, "CustomVoxelizer.hlsl", "vs", "vs_5_0", NULL);
 			dev->CreateInputLayout(desc, ARRAYSIZE(desc), blob->GetBufferPointer(), blob->GetBufferSize(), &mLayout);
+			dev->CreateInputLayout(descSnorm16, ARRAYSIZE(descSnorm16), blob->GetBufferPointer(), blob->GetBufferSize(), &mLayoutSnorm16);
 			dev->CreateVertexShader(blob->GetBufferPointer(), blob->GetBufferSize(), NULL, &mVertexShader);
 			blob->Release();
 		}
@@ -96,7 +103,7 @@ public:
 	void prepare(ID3D11DeviceContext* cont)
 	{
 		cont->VSSetShader(mVertexShader, NULL, 0);
-		cont->IASetInputLayout(mLayout);
+		cont->IASetInputLayout(mPositionFormat == AHD::PF_SNORM16 ? mLayoutSnorm16 : mLayout);
 		cont->VSSetConstantBuffers(0, 1, &mConstantBuffer);
 		cont->PSSetConstantBuffers(0, 1, &mConstantBuffer);
 
@@ -138,17 +145,25 @@ public:
 		mConstantBuffer->Release();
 		mVertexShader->Release();
 		mLayout->Release();
+		mLayoutSnorm16->Release();
 		for (auto i : mPixelShader)
 		{
 			i->Release();
 		}
 		mSampler->Release();
 	}
+	void setPositionFormat(AHD::PositionFormat format)
+	{
+		mPositionFormat = format;
+	}
+
 	int getElementSize()const{ return 4; }
 
 	ID3D11VertexShader* mVertexShader;
 	ID3D11PixelShader* mPixelShader[NUM];
 	ID3D11InputLayout* mLayout;
+	ID3D11InputLayout* mLayoutSnorm16;
+	AHD::PositionFormat mPositionFormat = AHD::PF_FLOAT3;
 	ID3D11Buffer* mConstantBuffer;
 	ID3D11SamplerState*		mSampler;
 	std::map<std::string, ID3D11ShaderResourceView*> mTextureMap;
@@ -12,7 +12,10 @@
 #include <deque>
 #include "tiny_obj_loader.h"
 #include "AHDUtils.h"
-#include "ring.h"
+#include "AHDParallel.h"
+#include "AHDMesher.h"
+#include "AHDVoxelWorld.h"
+#include "AHDRayCast.h"
 #include "TextureLoader.h"
 #include "Effect.h"
 
@@ -25,6 +28,13 @@ using namespace tinyobj;
 
 float scale = 20;
 const char* modelname = "cup.obj";
+//voxelize straight from the obj file in batches instead of loading the shapes,
+//for models that do not fit in memory as shape_t
+bool streamModel = false;
+MeshMode meshMode = MM_GREEDY;
+bool ambientOcclusion = true;
+//drop the faces of sealed cavities that can not be seen from outside
+bool exteriorOnly = true;
 
 
 
@@ -42,13 +52,24 @@ ID3D11Texture2D*        depthStencil = NULL;
 ID3D11DepthStencilView* depthStencilView = NULL;
 ID3D11RasterizerState* rasterizerState = NULL;
 
-ID3D11Buffer*		optimizedVertices = NULL;
-ID3D11Buffer*		optimizedIndexes = NULL;
-size_t drawCount = 0;
+//gpu buffers of a chunk of the world, empty chunks have none
+struct ChunkBuffer
+{
+	ID3D11Buffer* vertices = NULL;
+	ID3D11Buffer* indexes = NULL;
+	DXGI_FORMAT indexFormat = DXGI_FORMAT_R16_UINT;
+	UINT drawCount = 0;
+};
 
 VoxelData		voxels;
-std::vector<shape_t> shapes;
-std::vector<material_t> materials;
+VoxelWorld		world;
+//the voxels of the world for picking, kept in step with its edits
+RayCaster		picker;
+std::vector<ChunkBuffer> chunkBuffers;
+ID3D11Buffer*	paletteBuffer = NULL;
+ID3D11ShaderResourceView* paletteView = NULL;
+//the shapes are views into the mapped cache file, which stays open while they are used
+MeshCache meshCache;
 
 struct Material
 {
@@ -124,6 +145,10 @@ public:
 	{
 		effect->update(paras);
 	}
+	void setPositionFormat(PositionFormat format)
+	{
+		effect->setPositionFormat(format);
+	}
 	void clean()
 	{
 
@@ -154,6 +179,7 @@ enum Key
 
 
 void voxelize(float s = 1.0);
+void pickVoxel(int x, int y);
 
 LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 {
@@ -190,7 +216,12 @@ LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
 		case WM_LBUTTONUP: mButtonState[MouseLeft] = false; break;
 		case WM_RBUTTONDOWN: mButtonState[MouseRight] = true; break;
 		case WM_RBUTTONUP: mButtonState[MouseRight] = false; break;
-		case WM_MBUTTONDOWN: mButtonState[MouseMid] = true; break;
+		case WM_MBUTTONDOWN:
+		{
+			mButtonState[MouseMid] = true;
+			pickVoxel((short)LOWORD(lParam), (short)HIWORD(lParam));
+		}
+			break;
 		case WM_MBUTTONUP: mButtonState[MouseMid] = false; break;
 		case WM_MOUSEWHEEL:
 		{
@@ -450,9 +481,8 @@ HRESULT initDevice()
 	// Define the input layout
 	D3D11_INPUT_ELEMENT_DESC layout[] =
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-		{ "COLOR", 0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, 24, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "POSITION", 0, DXGI_FORMAT_R8G8B8A8_UINT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+		{ "COLOR", 0, DXGI_FORMAT_R16G16_UINT, 0, 4, D3D11_INPUT_PER_VERTEX_DATA, 0 },
 
 	};
 	UINT numElements = ARRAYSIZE(layout);
@@ -540,7 +570,13 @@ HRESULT initGeometry()
 	std::cout << "Loading ...";
 	long timer = GetTickCount();
 
-	LoadObj(shapes, materials, modelname);
+	//parsed once, later runs read the binary cache next to the model
+	if (!streamModel)
+	{
+		std::string err = meshCache.Open(modelname);
+		if (!err.empty())
+			std::cout << err;
+	}
 
 	std::cout << (GetTickCount() - timer) << " ms" << std::endl;
 
@@ -551,240 +587,221 @@ HRESULT initGeometry()
 
 }
 
-void optimizeVoxels()
+void releaseChunk(ChunkBuffer& chunk)
 {
-	enum FaceType
-	{
-		P_X = 1,
-		P_Y = 1 << 1,
-		P_Z = 1 << 2,
-		N_X = 1 << 3,
-		N_Y = 1 << 4,
-		N_Z = 1 << 5,
-	};
-
-	struct Pos
-	{
-		int x, y, z;
-	};
+	if (chunk.vertices)
+		chunk.vertices->Release();
+	if (chunk.indexes)
+		chunk.indexes->Release();
+	chunk = ChunkBuffer();
+}
 
-	enum Check
-	{
-		C_NONE = 0,
-		C_INSERT,
-	};
+void updatePalette()
+{
+	const std::vector<int>& colors = world.getPalette().getColors();
+	if (colors.empty())
+		return;
+
+	if (paletteView)
+		paletteView->Release();
+	if (paletteBuffer)
+		paletteBuffer->Release();
+
+	createBuffer(&paletteBuffer, D3D11_BIND_SHADER_RESOURCE, colors.size() * sizeof(int), colors.data());
+
+	D3D11_SHADER_RESOURCE_VIEW_DESC desc;
+	ZeroMemory(&desc, sizeof(desc));
+	desc.Format = DXGI_FORMAT_R32_UINT;
+	desc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+	desc.Buffer.FirstElement = 0;
+	desc.Buffer.NumElements = colors.size();
+	device->CreateShaderResourceView(paletteBuffer, &desc, &paletteView);
+}
 
-	struct Block
+//re-meshes the dirty chunks of the world and uploads them
+void updateChunks()
+{
+	std::vector<int> dirty;
+	for (int i = 0; i < world.getChunkCount(); ++i)
 	{
-		Pos pos;
-		int face;
-		int color;
-		Check check;
-	};
-
-
+		if (world.isDirty(i))
+			dirty.push_back(i);
+	}
 
-	const int* data = (const int *)voxels.datas.data();
-	int width = voxels.width;
-	int height = voxels.height;
-	int depth = voxels.depth;
-	int count = width * height * depth;
+	size_t paletteSize = world.getPalette().getSize();
 
-	std::vector<Block> blocks(count);
+	Mesher mesher;
+	mesher.setMode(meshMode);
+	mesher.setAmbientOcclusion(ambientOcclusion);
+	world.update(mesher);
 
-	auto getVoxel = [&data, width, height, depth](int x, int y, int z)->const int*
+	chunkBuffers.resize(world.getChunkCount());
+	for (auto i : dirty)
 	{
-		if (x < width && y < height && z < depth)
-			return data + x + y * width + z * height * width;
-		return nullptr;
-	};
+		ChunkBuffer& chunk = chunkBuffers[i];
+		releaseChunk(chunk);
 
-	auto checkBlock = [](Block& b1, Block& b2, FaceType face)
-	{
-		if ( (b1.color == 0) == (b2.color == 0) )
-			return;
+		const std::vector<PackedVertex>& vertices = world.getVertices(i);
+		if (vertices.empty())
+			continue;
+
+		createBuffer(&chunk.vertices, D3D11_BIND_VERTEX_BUFFER, vertices.size() * sizeof(PackedVertex), vertices.data());
 
-		if (b1.color == 0)
+		const std::vector<unsigned short>& shortIndexes = world.getShortIndexes(i);
+		const std::vector<unsigned int>& indexes = world.getIndexes(i);
+		if (!shortIndexes.empty())
 		{
-			switch (face)
-			{
-			case P_X: b2.face |= N_X; break;
-			case P_Y: b2.face |= N_Y; break;
-			case P_Z: b2.face |= N_Z; break;
-			default:
-				assert(0);
-			}
+			createBuffer(&chunk.indexes, D3D11_BIND_INDEX_BUFFER, shortIndexes.size() * sizeof(unsigned short), shortIndexes.data());
+			chunk.indexFormat = DXGI_FORMAT_R16_UINT;
+			chunk.drawCount = shortIndexes.size();
 		}
 		else
-			b1.face |= face;
-	};
+		{
+			createBuffer(&chunk.indexes, D3D11_BIND_INDEX_BUFFER, indexes.size() * sizeof(unsigned int), indexes.data());
+			chunk.indexFormat = DXGI_FORMAT_R32_UINT;
+			chunk.drawCount = indexes.size();
+		}
+	}
 
-	auto getIndex = [width, height](int x, int y, int z)
-	{
-		return x + y * width + z * height * width;
-	};
+	if (world.getPalette().getSize() != paletteSize || !paletteView)
+		updatePalette();
+}
 
-	struct Vertex
-	{
-		Vector3 p;
-		Vector3 n;
-		int color;
-	};
+void optimizeVoxels()
+{
+	for (auto& i : chunkBuffers)
+		releaseChunk(i);
+	chunkBuffers.clear();
 
-	struct Face
-	{
-		Vertex verts[4];
-		void setup(const Pos& offset, int color)
-		{
-			for (auto& i : verts)
-			{
-				i.p.x += offset.x;
-				i.p.y += offset.y;
-				i.p.z += offset.z;
-				i.color = color;
-			}
-		}
+	world.fromVoxels(voxels);
+	world.setExteriorOnly(exteriorOnly);
+	picker.build(voxels);
+	updateChunks();
 
+	size_t triangles = 0;
+	for (auto& i : chunkBuffers)
+		triangles += i.drawCount / 3;
+	std::cout << triangles << " triangles ";
 
-	};
-	const Face cube[] =
+	assert(triangles != 0 && "nothing is voxelized.");
+}
+
+void voxelizeShapes(Voxelizer& v, VoxelOutput* output, SponzaEffect& sponzaEffect, std::vector<EffectProxy>& effects)
+{
+	const std::vector<shape_view_t>& shapes = meshCache.GetShapes();
+	const std::vector<material_t>& materials = meshCache.GetMaterials();
+	effects.resize(shapes.size());
+
+	for (int i = 0; i < shapes.size();++i)
 	{
-		//P_X
-		{ 
-			Vector3(1, 0, 0), Vector3::UNIT_X,0,
-			Vector3(1, 0, 1), Vector3::UNIT_X, 0,
-			Vector3(1, 1, 1), Vector3::UNIT_X, 0,
-			Vector3(1, 1, 0), Vector3::UNIT_X, 0
-		},
-		//P_Y
-		{ 
-			Vector3(0, 1, 0), Vector3::UNIT_Y, 0,
-			Vector3(1, 1, 0), Vector3::UNIT_Y, 0,
-			Vector3(1, 1, 1), Vector3::UNIT_Y, 0,
-			Vector3(0, 1, 1), Vector3::UNIT_Y ,0
-		},
-		//P_Z
-		{
-			Vector3(0, 0, 1), Vector3::UNIT_Z, 0,
-			Vector3(0, 1, 1), Vector3::UNIT_Z, 0,
-			Vector3(1, 1, 1), Vector3::UNIT_Z, 0,
-			Vector3(1, 0, 1), Vector3::UNIT_Z, 0
-		},
-		//N_X
-		{ 
-			Vector3(0, 0, 0), Vector3::NEGATIVE_UNIT_X, 0,
-			Vector3(0, 1, 0), Vector3::NEGATIVE_UNIT_X, 0,
-			Vector3(0, 1, 1), Vector3::NEGATIVE_UNIT_X, 0,
-			Vector3(0, 0, 1), Vector3::NEGATIVE_UNIT_X, 0
-		},
-		//N_Y
-		{ 
-			Vector3(0, 0, 0), Vector3::NEGATIVE_UNIT_Y, 0,
-			Vector3(0, 0, 1), Vector3::NEGATIVE_UNIT_Y, 0,
-			Vector3(1, 0, 1), Vector3::NEGATIVE_UNIT_Y, 0,
-			Vector3(1, 0, 0), Vector3::NEGATIVE_UNIT_Y, 0
-		},
-		//N_Z
+		std::string texDiff, texAmb;
+		if (shapes[i].num_material_ids != 0)
 		{
-			Vector3(0, 0, 0), Vector3::NEGATIVE_UNIT_Z, 0,
-			Vector3(1, 0, 0), Vector3::NEGATIVE_UNIT_Z, 0,
-			Vector3(1, 1, 0), Vector3::NEGATIVE_UNIT_Z, 0,
-			Vector3(0, 1, 0), Vector3::NEGATIVE_UNIT_Z, 0
-		},
+			auto& mat = materials[shapes[i].material_ids[0]];
 
-	};
+			memcpy(effects[i].constant.diffuse, mat.diffuse, sizeof(float) * 3);
+			memcpy(effects[i].constant.ambient, mat.ambient, sizeof(float) * 3);
+			effects[i].constant.diffuse[3] = 1;
+			effects[i].constant.ambient[3] = 1;
+			texDiff = mat.diffuse_texname;
+			sponzaEffect.addTexture(texDiff);
+			effects[i].texture = texDiff;
+			effects[i].effect = &sponzaEffect;
+		}
+	}
 
-	
+	//the mapped arrays go to the gpu as they are, positions in slot 0 and texcoords in slot 1
+	std::vector<VoxelResource*> subs(shapes.size());
+	v.createResources(subs.size(), subs.data());
+	parallelFor(0, shapes.size(), [&](size_t i)
+	{
+		const shape_view_t& shape = shapes[i];
+		size_t size = shape.num_positions / 3;
+
+		auto res = subs[i];
+		res->setVertex(shape.positions, size, sizeof(float) * 3);
+		if (shape.num_texcoords != 0)
+			res->setTexcoord(shape.texcoords, size);
+		res->setIndex(shape.indices, shape.num_indices, 4);
+		res->setEffect(&effects[i]);
+	});
 
-	ring<Block*> testQueue;
-	blocks[0] = { { 0, 0, 0 }, *getVoxel(0, 0, 0) ? N_X | N_Y | N_Z : 0, *getVoxel(0, 0, 0), C_INSERT };
-	testQueue.push_back(&blocks[0]);
+	v.addEffect(&sponzaEffect);
 
-	std::vector<Face> faces;
-	std::vector<size_t> indexes;
 
-	while (!testQueue.empty())
-	{
-		Block& b = **testQueue.begin();
-		const struct
-		{
-			Pos p;
-			FaceType f;
-		}pos[3] =
-		{
-			{ b.pos.x + 1, b.pos.y, b.pos.z, P_X },
-			{ b.pos.x, b.pos.y + 1, b.pos.z, P_Y },
-			{ b.pos.x, b.pos.y, b.pos.z + 1, P_Z }
-		};
+	v.voxelize(output, subs.size(), subs.data());
+}
 
-		for (int i = 0; i < 3; ++i)
-		{
-			const Pos& p = pos[i].p;
-			const int * color = getVoxel(p.x, p.y, p.z);
-			if (color == nullptr)//out of range
-				continue;
-			Block& next = blocks[getIndex(p.x, p.y, p.z)];
-			if (next.check != C_INSERT)
-			{
-				next = { p, 0, *color, C_INSERT };
-				next.face =
-					(p.x ? 0 : N_X) |
-					(p.y ? 0 : N_Y) |
-					(p.z ? 0 : N_Z) |
-					(p.x == width - 1 ? P_X : 0) |
-					(p.y == height - 1 ? P_Y : 0) | 
-					(p.z == depth - 1 ? P_Z : 0) ;
-				testQueue.push_back(&next);
-			}
-			checkBlock(b, next, pos[i].f);
+class VoxelizeSink : public TriangleSink
+{
+public:
+	Voxelizer* voxelizer;
+	VoxelOutput* output;
+	SponzaEffect* sponzaEffect;
+	std::vector<EffectProxy>* effects;
+	bool begun = false;
 
-		}
-		if (b.color != 0)
+	void Begin(const float bmin[3], const float bmax[3], const std::vector<material_t>& mats)
+	{
+		//one effect per material, the last one is for faces without material
+		effects->resize(mats.size() + 1);
+		for (size_t i = 0; i < effects->size(); ++i)
 		{
-			for (int i = 0; i < 6; ++i)
+			EffectProxy& e = (*effects)[i];
+			e.effect = sponzaEffect;
+			if (i == mats.size())
 			{
-				int mask = 1 << i;
-				if ((mask & b.face) == 0)
-					continue;
-
-				size_t indexBegin = faces.size() * 4;
-				const size_t indexSample[]=
+				for (int j = 0; j < 4; ++j)
 				{
-					0,1,2,
-					0,2,3,
-				};
-				for (auto i : indexSample)
-				{
-					indexes.push_back(indexBegin + i);
+					e.constant.diffuse[j] = 1;
+					e.constant.ambient[j] = 0;
 				}
-
-				Face face = cube[i];
-				//face.color = b.color;
-				face.setup(b.pos, b.color);
-				faces.push_back(face);
-
-
+				continue;
 			}
+
+			memcpy(e.constant.diffuse, mats[i].diffuse, sizeof(float) * 3);
+			memcpy(e.constant.ambient, mats[i].ambient, sizeof(float) * 3);
+			e.constant.diffuse[3] = 1;
+			e.constant.ambient[3] = 1;
+			e.texture = mats[i].diffuse_texname;
+			sponzaEffect->addTexture(e.texture);
 		}
 
-		testQueue.pop_front();
-	}
+		voxelizer->addEffect(sponzaEffect);
 
-	assert(!faces.empty() && "nothing is voxelized.");
+		AABB aabb;
+		aabb.setExtents(Vector3(bmin[0], bmin[1], bmin[2]), Vector3(bmax[0], bmax[1], bmax[2]));
+		voxelizer->beginVoxelize(output, aabb);
+		begun = true;
+	}
 
-	if (optimizedVertices)
-		optimizedVertices->Release();
-	HRESULT hr = createBuffer(&optimizedVertices, D3D11_BIND_VERTEX_BUFFER, faces.size() * sizeof(Face), faces.data());
-	UINT stride = sizeof(Vertex);
-	UINT offset = 0;
-	context->IASetVertexBuffers(0, 1, &optimizedVertices, &stride, &offset);
+	void Consume(const triangle_batch_t& batch)
+	{
+		size_t index = batch.material_id < 0 ? effects->size() - 1 : batch.material_id;
+		voxelizer->voxelizeBatch(batch.vertices, batch.num_triangles * 3, sizeof(float) * 5, &(*effects)[index], sizeof(float) * 3);
+	}
+};
 
-	if (optimizedIndexes)
-		optimizedIndexes->Release();
-	hr = createBuffer(&optimizedIndexes, D3D11_BIND_INDEX_BUFFER, sizeof(size_t)* indexes.size(), indexes.data());
-	drawCount = indexes.size();
-	context->IASetIndexBuffer(optimizedIndexes, DXGI_FORMAT_R32_UINT, 0);
+//returns false when the obj could not be read, the output is not prepared then
+bool voxelizeStream(Voxelizer& v, VoxelOutput* output, SponzaEffect& sponzaEffect, std::vector<EffectProxy>& effects)
+{
+	VoxelizeSink sink;
+	sink.voxelizer = &v;
+	sink.output = output;
+	sink.sponzaEffect = &sponzaEffect;
+	sink.effects = &effects;
+
+	std::string err = LoadObjStreamed(modelname, sink);
+	if (!err.empty())
+	{
+		std::cout << err;
+		//errors before the first batch come before beginVoxelize
+		if (!sink.begun)
+			return false;
+	}
 
+	v.endVoxelize();
+	return true;
 }
 
 void voxelize(float s)
@@ -799,63 +816,16 @@ void voxelize(float s)
 	long timer = GetTickCount();
 
 	SponzaEffect sponzaEffect;
-	std::vector<EffectProxy> effects(shapes.size());
-	
+	std::vector<EffectProxy> effects;
 
-	std::vector<VoxelResource*> subs;
-	AABB aabb;
-	std::vector<char> buffer;
-	for (int i = 0; i < shapes.size();++i)
+	//the previous voxels stay when the model can not be read
+	if (streamModel)
 	{
-		std::string texDiff, texAmb;
-		auto& matidvec = shapes[i].mesh.material_ids;
-		if (!matidvec.empty())
-		{
-			auto& mat = materials[matidvec[0]];
-
-			memcpy(effects[i].constant.diffuse, mat.diffuse, sizeof(float) * 3);
-			memcpy(effects[i].constant.ambient, mat.ambient, sizeof(float) * 3);
-			effects[i].constant.diffuse[3] = 1;
-			effects[i].constant.ambient[3] = 1;
-			texDiff = mat.diffuse_texname;
-			sponzaEffect.addTexture(texDiff);
-			effects[i].texture = texDiff;
-			effects[i].effect = &sponzaEffect;
-		}
-
-
-		size_t size = shapes[i].mesh.positions.size() / 3;
-		const size_t stride = 12 + 8;
-		buffer.reserve(size * stride);
-		char* data = buffer.data();
-		char* begin = data;
-		bool usetexcoord = !shapes[i].mesh.texcoords.empty();
-		for (size_t j = 0; j < size; ++j)
-		{
-			memcpy(begin, &shapes[i].mesh.positions[j * 3], 12);
-			begin += 12;
-			if (usetexcoord)
-				memcpy(begin, &shapes[i].mesh.texcoords[j * 2], 8);
-
-			begin += 8;
-		}
-
-
-		auto res = v.createResource();
-		res->setVertex(data, size, stride);
-		res->setIndex(shapes[i].mesh.indices.data(), shapes[i].mesh.indices.size(), 4);
-		res->setEffect(&effects[i]);
-
-		subs.push_back(res);
-
+		if (!voxelizeStream(v, output, sponzaEffect, effects))
+			return;
 	}
-
-	buffer.swap(std::vector<char>());
-
-	v.addEffect(&sponzaEffect);
-
-
-	v.voxelize(output, subs.size(), subs.data());
+	else
+		voxelizeShapes(v, output, sponzaEffect, effects);
 
 	output->exportData(voxels, 1);
 
@@ -878,8 +848,10 @@ void cleanDevice()
 {
 #define SAFE_RELEASE(x) if (x) (x)->Release();
 
-	SAFE_RELEASE(optimizedVertices);
-	SAFE_RELEASE(optimizedIndexes);
+	for (auto& i : chunkBuffers)
+		releaseChunk(i);
+	SAFE_RELEASE(paletteView);
+	SAFE_RELEASE(paletteBuffer);
 	SAFE_RELEASE(rasterizerState);
 	SAFE_RELEASE(depthStencil);
 	SAFE_RELEASE(depthStencilView);
@@ -895,6 +867,40 @@ void cleanDevice()
 
 }
 
+//removes the voxel under the cursor
+void pickVoxel(int x, int y)
+{
+	if (chunkBuffers.empty())
+		return;
+
+	RECT rc;
+	GetClientRect(window, &rc);
+	float width = (float)(rc.right - rc.left);
+	float height = (float)(rc.bottom - rc.top);
+
+	//the matrices are stored transposed for the shader. unprojecting through the world matrix
+	//gives the cursor ray in voxel units
+	XMMATRIX proj = XMMatrixTranspose(constants.proj);
+	XMMATRIX view = XMMatrixTranspose(constants.view);
+	XMMATRIX toWorld = XMMatrixTranspose(constants.world);
+	XMVECTOR nearPoint = XMVector3Unproject(XMVectorSet((float)x, (float)y, 0, 0), 0, 0, width, height, 0, 1, proj, view, toWorld);
+	XMVECTOR farPoint = XMVector3Unproject(XMVectorSet((float)x, (float)y, 1, 0), 0, 0, width, height, 0, 1, proj, view, toWorld);
+	XMVECTOR dir = farPoint - nearPoint;
+
+	Ray ray;
+	ray.origin = Vector3(XMVectorGetX(nearPoint), XMVectorGetY(nearPoint), XMVectorGetZ(nearPoint));
+	ray.direction = Vector3(XMVectorGetX(dir), XMVectorGetY(dir), XMVectorGetZ(dir));
+	ray.maxDistance = 1;
+
+	RayHit hit;
+	if (!picker.cast(ray, hit))
+		return;
+
+	world.clear(hit.voxel[0], hit.voxel[1], hit.voxel[2]);
+	picker.setVoxel(hit.voxel[0], hit.voxel[1], hit.voxel[2], false);
+	updateChunks();
+}
+
 void render()
 {
 	// Clear the back buffer 
@@ -912,15 +918,32 @@ void render()
 
 	context->VSSetShader(vertexShader, NULL, 0);
 	context->PSSetShader(pixelShader, NULL, 0);
+	context->VSSetShaderResources(0, 1, &paletteView);
 
 
-	variables.local = XMMatrixIdentity();
 	//variables.kd = XMFLOAT4(content[0] / 255., content[1] / 255., content[2] / 255., content[3] / 255.);
 	variables.kd = XMFLOAT4(0.5, 0.5, 0.5, 1);
 	variables.ks = XMFLOAT4(0, 0, 0, 0);
 	variables.ns = 0;
-	context->UpdateSubresource(variableBuffer, 0, NULL, &variables, 0, 0);
-	context->DrawIndexed(drawCount, 0, 0);
+
+	//chunk vertices are relative to the chunk, local moves them to the chunk origin
+	UINT stride = sizeof(PackedVertex);
+	UINT offset = 0;
+	for (size_t i = 0; i < chunkBuffers.size(); ++i)
+	{
+		const ChunkBuffer& chunk = chunkBuffers[i];
+		if (chunk.drawCount == 0)
+			continue;
+
+		int origin[3];
+		world.getChunkOrigin((int)i, origin);
+		variables.local = XMMatrixTranspose(XMMatrixTranslation((float)origin[0], (float)origin[1], (float)origin[2]));
+		context->UpdateSubresource(variableBuffer, 0, NULL, &variables, 0, 0);
+
+		context->IASetVertexBuffers(0, 1, &chunk.vertices, &stride, &offset);
+		context->IASetIndexBuffer(chunk.indexes, chunk.indexFormat, 0);
+		context->DrawIndexed(chunk.drawCount, 0, 0);
+	}
 	swapChain->Present(0, 0);
 }
 
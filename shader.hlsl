@@ -13,13 +13,24 @@ struct VS_OUTPUT
 	float4 color: COLOR0;
 };
 
+//packed chunk vertex: xyz in the chunk and the normal id in w, the palette index in x of color
+//and the ambient occlusion (0 to 3) in the low byte of y
 struct VS_INPUT
 {
-	float4 Pos : POSITION;
-	float3 Norm : NORMAL;
-	float4 Color: COLOR0;
+	uint4 Pos : POSITION;
+	uint2 Color: COLOR0;
 };
 
+//the normal ids, in the order of AHD::FaceDirection
+static const float3 normals[6] =
+{
+	float3(1, 0, 0), float3(0, 1, 0), float3(0, 0, 1),
+	float3(-1, 0, 0), float3(0, -1, 0), float3(0, 0, -1),
+};
+
+//rgba8 voxel colors
+Buffer<uint> palette : register(t0);
+
 cbuffer cbNeverChanges : register(b0)
 {
 	matrix World;
@@ -44,18 +55,20 @@ cbuffer cbVariable: register(b1)
 VS_OUTPUT VS(VS_INPUT input)
 {
 	VS_OUTPUT o;   
-	o.pos = mul(input.Pos, local);
+	o.pos = mul(float4(input.Pos.xyz, 1), local);
 	o.pos = mul(o.pos, World);
 	o.worldPos = (float3) o.pos;
 	o.pos = mul(o.pos, View);
 	o.pos = mul(o.pos, Projection);
 
 
-	o.normal = mul(input.Norm, local);
+	o.normal = mul(normals[input.Pos.w], local);
 	o.normal = mul(o.normal, World);
 	o.normal = normalize(o.normal);
 
-	o.color = input.Color;
+	uint color = palette[input.Color.x];
+	o.color = float4(color & 0xff, (color >> 8) & 0xff, (color >> 16) & 0xff, color >> 24) / 255;
+	o.color.rgb *= 0.4 + 0.2 * (input.Color.y & 0xff);
     return o;
 }
 
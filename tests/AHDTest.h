@@ -0,0 +1,33 @@
+#ifndef _AHDTest_H_
+#define _AHDTest_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+
+//a minimal test runner for the parts of AHD that do not need d3d11.
+//tests register themselves with TEST, CHECK records a failure and goes on
+namespace AHDTest
+{
+	typedef void (*TestFunc)();
+
+	struct TestCase
+	{
+		TestCase(const char* name, TestFunc func);
+	};
+
+	void fail(const char* file, int line, const char* expression);
+
+	//uniform in [0, 1), the same sequence on every platform
+	float randomFloat();
+	//uniform in [0, n)
+	int randomInt(int n);
+}
+
+#define TEST(name) \
+	static void test##name(); \
+	static AHDTest::TestCase testCase##name(#name, test##name); \
+	static void test##name()
+
+#define CHECK(x) { if (!(x)) AHDTest::fail(__FILE__, __LINE__, #x); }
+
+#endif
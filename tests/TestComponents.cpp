@@ -0,0 +1,97 @@
+#include "AHDTest.h"
+#include "AHDComponents.h"
+#include <deque>
+
+using namespace AHD;
+using namespace AHDTest;
+
+TEST(Components)
+{
+	const int sizes[][3] = { { 1, 1, 1 }, { 5, 4, 3 }, { 70, 13, 17 } };
+	const int fills[] = { 20, 45, 70 };
+	for (auto& size : sizes)
+	{
+		for (int connectivity = CN_6; connectivity <= CN_26; ++connectivity)
+		{
+			for (int fill : fills)
+			{
+				const int w = size[0], h = size[1], d = size[2];
+				BitGrid grid(w, h, d);
+				for (int z = 0; z < d; ++z)
+				{
+					for (int y = 0; y < h; ++y)
+					{
+						for (int x = 0; x < w; ++x)
+							grid.set(x, y, z, randomInt(100) < fill);
+					}
+				}
+
+				std::vector<unsigned int> labels;
+				std::vector<VoxelComponent> components;
+				labelComponents(grid, (Connectivity)connectivity, labels, components);
+
+				//breadth first search from every unlabeled voxel in scan order
+				std::vector<unsigned int> expected((size_t)w * h * d, 0);
+				std::vector<VoxelComponent> expectedComponents;
+				for (int i = 0; i < w * h * d; ++i)
+				{
+					const int x = i % w, y = i / w % h, z = i / (w * h);
+					if (!grid.get(x, y, z) || expected[i] != 0)
+						continue;
+
+					VoxelComponent c = { 0, { x, y, z }, { x, y, z } };
+					const unsigned int label = (unsigned int)expectedComponents.size() + 1;
+					std::deque<int> queue(1, i);
+					expected[i] = label;
+					while (!queue.empty())
+					{
+						const int j = queue.front();
+						queue.pop_front();
+						const int p[3] = { j % w, j / w % h, j / (w * h) };
+						++c.count;
+						for (int k = 0; k < 3; ++k)
+						{
+							c.min[k] = std::min(c.min[k], p[k]);
+							c.max[k] = std::max(c.max[k], p[k]);
+						}
+
+						for (int dz = -1; dz <= 1; ++dz)
+						{
+							for (int dy = -1; dy <= 1; ++dy)
+							{
+								for (int dx = -1; dx <= 1; ++dx)
+								{
+									const int steps = abs(dx) + abs(dy) + abs(dz);
+									if (steps == 0 || (connectivity == CN_6 && steps != 1))
+										continue;
+									const int nx = p[0] + dx, ny = p[1] + dy, nz = p[2] + dz;
+									if (nx < 0 || ny < 0 || nz < 0 || nx >= w || ny >= h || nz >= d)
+										continue;
+									const int n = (nz * h + ny) * w + nx;
+									if (grid.get(nx, ny, nz) && expected[n] == 0)
+									{
+										expected[n] = label;
+										queue.push_back(n);
+									}
+								}
+							}
+						}
+					}
+					expectedComponents.push_back(c);
+				}
+
+				CHECK(labels == expected);
+				CHECK(components.size() == expectedComponents.size());
+				for (size_t i = 0; i < std::min(components.size(), expectedComponents.size()); ++i)
+				{
+					CHECK(components[i].count == expectedComponents[i].count);
+					for (int k = 0; k < 3; ++k)
+					{
+						CHECK(components[i].min[k] == expectedComponents[i].min[k]);
+						CHECK(components[i].max[k] == expectedComponents[i].max[k]);
+					}
+				}
+			}
+		}
+	}
+}
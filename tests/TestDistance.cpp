@@ -0,0 +1,90 @@
+#include "AHDTest.h"
+#include "AHDDistance.h"
+#include <math.h>
+#include <limits>
+
+using namespace AHD;
+using namespace AHDTest;
+
+namespace
+{
+	//the distance from voxel i to the nearest voxel whose bit is target, by trying all of them
+	double bruteDistance(const BitGrid& grid, int x, int y, int z, bool target)
+	{
+		double best = std::numeric_limits<double>::infinity();
+		for (int c = 0; c < grid.getDepth(); ++c)
+		{
+			for (int b = 0; b < grid.getHeight(); ++b)
+			{
+				for (int a = 0; a < grid.getWidth(); ++a)
+				{
+					if (grid.get(a, b, c) != target)
+						continue;
+					double d = sqrt((double)(a - x) * (a - x) + (double)(b - y) * (b - y) + (double)(c - z) * (c - z));
+					best = std::min(best, d);
+				}
+			}
+		}
+		return best;
+	}
+
+	bool same(double expected, float value)
+	{
+		if (isinf(expected))
+			return isinf(value) && (expected > 0) == (value > 0);
+		return fabs(expected - value) < 1e-4;
+	}
+}
+
+TEST(DistanceBruteForce)
+{
+	const int sizes[][3] = { { 1, 1, 1 }, { 7, 5, 3 }, { 19, 11, 6 } };
+	const int fills[] = { 0, 3, 40, 100 };
+	for (auto& size : sizes)
+	{
+		for (int fill : fills)
+		{
+			BitGrid grid(size[0], size[1], size[2]);
+			for (int z = 0; z < size[2]; ++z)
+			{
+				for (int y = 0; y < size[1]; ++y)
+				{
+					for (int x = 0; x < size[0]; ++x)
+						grid.set(x, y, z, randomInt(100) < fill);
+				}
+			}
+
+			std::vector<float> distances, signedDistances;
+			computeDistanceField(grid, distances);
+			computeDistanceField(grid, signedDistances, true);
+			for (int z = 0; z < size[2]; ++z)
+			{
+				for (int y = 0; y < size[1]; ++y)
+				{
+					for (int x = 0; x < size[0]; ++x)
+					{
+						size_t i = ((size_t)z * size[1] + y) * size[0] + x;
+						double outside = bruteDistance(grid, x, y, z, true);
+						CHECK(same(outside, distances[i]));
+						double expected = grid.get(x, y, z) ? -bruteDistance(grid, x, y, z, false) : outside;
+						CHECK(same(expected, signedDistances[i]));
+					}
+				}
+			}
+		}
+	}
+}
+
+//squared distances past 2^24 are no longer exact in a float
+TEST(DistanceLarge)
+{
+	BitGrid grid(9000, 1, 2);
+	grid.set(0, 0, 0, true);
+	std::vector<float> distances;
+	computeDistanceField(grid, distances);
+	for (int x = 0; x < 9000; ++x)
+	{
+		CHECK(distances[x] == (float)x);
+		CHECK(distances[9000 + x] == (float)sqrt((double)x * x + 1));
+	}
+}
@@ -0,0 +1,146 @@
+#include "AHDTest.h"
+#include "AHDMesher.h"
+#include <math.h>
+
+using namespace AHD;
+using namespace AHDTest;
+
+namespace
+{
+	int getVoxel(const VoxelData& data, int x, int y, int z)
+	{
+		if (x < 0 || y < 0 || z < 0 || x >= data.width || y >= data.height || z >= data.depth)
+			return 0;
+		return ((const int*)data.datas.data())[((size_t)z * data.height + y) * data.width + x];
+	}
+
+	//faces of filled voxels against empty ones, per FaceDirection
+	void countFaces(const VoxelData& data, size_t faces[6])
+	{
+		static const int NORMALS[6][3] = { { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }, { -1, 0, 0 }, { 0, -1, 0 }, { 0, 0, -1 } };
+		for (int i = 0; i < 6; ++i)
+			faces[i] = 0;
+		for (int z = 0; z < data.depth; ++z)
+		{
+			for (int y = 0; y < data.height; ++y)
+			{
+				for (int x = 0; x < data.width; ++x)
+				{
+					if (getVoxel(data, x, y, z) == 0)
+						continue;
+					for (int i = 0; i < 6; ++i)
+						faces[i] += getVoxel(data, x + NORMALS[i][0], y + NORMALS[i][1], z + NORMALS[i][2]) == 0 ? 1 : 0;
+				}
+			}
+		}
+	}
+
+	//the area of the triangles of the mesh per normal, in voxel faces
+	void measureMesh(const Mesher& mesher, size_t faces[6])
+	{
+		double area[6] = { 0, 0, 0, 0, 0, 0 };
+		const std::vector<MeshVertex>& vertices = mesher.getVertices();
+		const std::vector<unsigned int>& indexes = mesher.getIndexes();
+		for (size_t i = 0; i + 3 <= indexes.size(); i += 3)
+		{
+			const Vector3& a = vertices[indexes[i]].position;
+			const Vector3& b = vertices[indexes[i + 1]].position;
+			const Vector3& c = vertices[indexes[i + 2]].position;
+			double u[3] = { b.x - a.x, b.y - a.y, b.z - a.z };
+			double v[3] = { c.x - a.x, c.y - a.y, c.z - a.z };
+			double n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+
+			const Vector3& normal = vertices[indexes[i]].normal;
+			const float* axis = &normal.x;
+			int face = axis[0] != 0 ? 0 : axis[1] != 0 ? 1 : 2;
+			if (axis[face] < 0)
+				face += 3;
+			area[face] += sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5;
+		}
+		for (int i = 0; i < 6; ++i)
+			faces[i] = (size_t)(area[i] + 0.5);
+	}
+
+	VoxelData makeData(int width, int height, int depth)
+	{
+		VoxelData data;
+		data.width = width;
+		data.height = height;
+		data.depth = depth;
+		data.datas.assign((size_t)width * height * depth * sizeof(int), 0);
+		return data;
+	}
+}
+
+TEST(MesherFaces)
+{
+	VoxelData data = makeData(23, 17, 11);
+	int* voxels = (int*)data.datas.data();
+	for (int pass = 0; pass < 2; ++pass)
+	{
+		//noise with 2 colors, then a solid slab that greedy merging collapses
+		for (int i = 0; i < data.width * data.height * data.depth; ++i)
+		{
+			if (pass == 0)
+				voxels[i] = randomInt(3) == 0 ? 0 : 1 + randomInt(2);
+			else
+				voxels[i] = i / data.width % data.height < 10 ? 7 : 0;
+		}
+
+		size_t expected[6];
+		countFaces(data, expected);
+
+		Mesher cube, greedy;
+		cube.setMode(MM_CUBE);
+		greedy.setMode(MM_GREEDY);
+		cube.mesh(data);
+		greedy.mesh(data);
+
+		size_t cubeFaces[6], greedyFaces[6];
+		measureMesh(cube, cubeFaces);
+		measureMesh(greedy, greedyFaces);
+		size_t total = 0;
+		for (int i = 0; i < 6; ++i)
+		{
+			CHECK(cubeFaces[i] == expected[i]);
+			CHECK(greedyFaces[i] == expected[i]);
+			total += expected[i];
+		}
+		//two triangles per face, fewer after merging
+		CHECK(cube.getIndexes().size() == total * 6);
+		CHECK(greedy.getIndexes().size() <= cube.getIndexes().size());
+		if (pass == 1)
+			CHECK(greedy.getIndexes().size() == 6 * 6);
+	}
+}
+
+TEST(MesherExterior)
+{
+	//a hollow cube with a filled voxel inside, only the 6 outer sides face the exterior
+	VoxelData data = makeData(12, 12, 12);
+	int* voxels = (int*)data.datas.data();
+	for (int z = 1; z < 11; ++z)
+	{
+		for (int y = 1; y < 11; ++y)
+		{
+			for (int x = 1; x < 11; ++x)
+			{
+				bool shell = x == 1 || x == 10 || y == 1 || y == 10 || z == 1 || z == 10;
+				voxels[(z * 12 + y) * 12 + x] = shell || (x == 5 && y == 5 && z == 5) ? 1 : 0;
+			}
+		}
+	}
+
+	BitGrid grid, exterior;
+	grid.fromVoxels(data);
+	grid.getExterior(exterior);
+
+	Mesher mesher;
+	mesher.setMode(MM_CUBE);
+	mesher.setExterior(&exterior);
+	mesher.mesh(data);
+	size_t faces[6];
+	measureMesh(mesher, faces);
+	for (int i = 0; i < 6; ++i)
+		CHECK(faces[i] == 100);
+}
@@ -0,0 +1,130 @@
+#include "AHDTest.h"
+#include "tiny_obj_loader.h"
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+
+using namespace AHDTest;
+
+namespace
+{
+	const char* OBJ_FILE = "AHDTest.obj";
+
+	//vertices written as text in the ways exporters do, with the values strtod reads back
+	void writeObj(std::vector<std::string>& texts)
+	{
+		char buffer[64];
+		for (int i = 0; i < 3000; ++i)
+		{
+			double value = (randomFloat() - 0.5) * pow(10.0, randomInt(16) - 8);
+			switch (i % 6)
+			{
+			case 0: sprintf(buffer, "%.9g", value); break;
+			case 1: sprintf(buffer, "%.6f", value); break;
+			case 2: sprintf(buffer, "%e", value); break;
+			case 3: sprintf(buffer, "%.17g", value); break;
+			case 4: sprintf(buffer, "%d", randomInt(200000) - 100000); break;
+			default: sprintf(buffer, "%.25f", value); break;
+			}
+			texts.push_back(buffer);
+		}
+		texts[0] = "0.1";
+		texts[1] = "-0";
+		texts[2] = "1e-40";
+		texts[3] = "3.4028235e38";
+		texts[4] = "+.5";
+		texts[5] = "16777217";
+
+		FILE* file = fopen(OBJ_FILE, "wb");
+		CHECK(file != NULL);
+		if (file == NULL)
+			return;
+
+		fprintf(file, "# vertices in the formats of several exporters\n");
+		for (size_t i = 0; i + 3 <= texts.size(); i += 3)
+			fprintf(file, "v %s\t%s  %s\r\n", texts[i].c_str(), texts[i + 1].c_str(), texts[i + 2].c_str());
+		fprintf(file, "vt 0.25 0.75\nvn 0 0 1\n");
+		fprintf(file, "g first\n");
+		for (size_t i = 1; i + 2 <= texts.size() / 3; i += 2)
+			fprintf(file, "f %d/1/1 %d/1/1 %d/1/1\n", (int)i, (int)i + 1, (int)i + 2);
+		fprintf(file, "g second\nf -1 -2 -3 -4\n");
+		fclose(file);
+	}
+
+	bool sameShapes(const std::vector<tinyobj::shape_t>& shapes, const std::vector<tinyobj::shape_view_t>& views)
+	{
+		if (shapes.size() != views.size())
+			return false;
+
+		for (size_t i = 0; i < shapes.size(); ++i)
+		{
+			const tinyobj::mesh_t& m = shapes[i].mesh;
+			const tinyobj::shape_view_t& v = views[i];
+			if (shapes[i].name != v.name || m.positions.size() != v.num_positions || m.normals.size() != v.num_normals ||
+				m.texcoords.size() != v.num_texcoords || m.indices.size() != v.num_indices || m.material_ids.size() != v.num_material_ids)
+				return false;
+
+			if (!std::equal(m.positions.begin(), m.positions.end(), v.positions) ||
+				!std::equal(m.normals.begin(), m.normals.end(), v.normals) ||
+				!std::equal(m.texcoords.begin(), m.texcoords.end(), v.texcoords) ||
+				!std::equal(m.indices.begin(), m.indices.end(), v.indices) ||
+				!std::equal(m.material_ids.begin(), m.material_ids.end(), v.material_ids))
+				return false;
+		}
+		return true;
+	}
+}
+
+TEST(ObjLoader)
+{
+	std::vector<std::string> texts;
+	writeObj(texts);
+	std::string cacheFile = std::string(OBJ_FILE) + ".cache";
+	remove(cacheFile.c_str());
+
+	std::vector<tinyobj::shape_t> shapes;
+	std::vector<tinyobj::material_t> materials;
+	CHECK(tinyobj::LoadObj(shapes, materials, OBJ_FILE).empty());
+	CHECK(shapes.size() == 2);
+	if (shapes.size() != 2)
+		return;
+
+	//the positions of the first shape are the vertices in order, apart from the last ones only used by the second
+	const std::vector<float>& positions = shapes[0].mesh.positions;
+	CHECK(shapes[0].mesh.normals.size() == positions.size());
+	CHECK(shapes[1].mesh.indices.size() == 6);
+	for (size_t i = 0; i < positions.size(); ++i)
+	{
+		//bit for bit, so -0 and 0 differ
+		float expected = (float)strtod(texts[i].c_str(), NULL);
+		CHECK(memcmp(&positions[i], &expected, sizeof(float)) == 0);
+	}
+
+	//the first open builds the cache, the second maps it, both give the shapes of LoadObj
+	{
+		tinyobj::MeshCache cache;
+		CHECK(cache.Open(OBJ_FILE).empty());
+		CHECK(!cache.IsHit());
+		CHECK(sameShapes(shapes, cache.GetShapes()));
+	}
+	{
+		tinyobj::MeshCache cache;
+		CHECK(cache.Open(OBJ_FILE).empty());
+		CHECK(cache.IsHit());
+		CHECK(sameShapes(shapes, cache.GetShapes()));
+	}
+
+	std::vector<tinyobj::shape_t> cached;
+	CHECK(tinyobj::LoadObjCached(cached, materials, OBJ_FILE).empty());
+	CHECK(cached.size() == shapes.size());
+	for (size_t i = 0; i < std::min(cached.size(), shapes.size()); ++i)
+	{
+		CHECK(cached[i].mesh.positions == shapes[i].mesh.positions);
+		CHECK(cached[i].mesh.indices == shapes[i].mesh.indices);
+	}
+
+	remove(cacheFile.c_str());
+	remove(OBJ_FILE);
+}
@@ -0,0 +1,71 @@
+#include "AHDTest.h"
+#include "AHDParallel.h"
+#include <stdexcept>
+
+using namespace AHD;
+using namespace AHDTest;
+
+TEST(ParallelFor)
+{
+	//every index exactly once, with and without a grain
+	for (size_t grain = 1; grain <= 64; grain *= 8)
+	{
+		std::vector<std::atomic<int> > counts(10000);
+		for (auto& i : counts)
+			i = 0;
+		parallelFor(0, counts.size(), [&](size_t i)
+		{
+			++counts[i];
+		}, grain);
+
+		bool once = true;
+		for (auto& i : counts)
+			once = once && i == 1;
+		CHECK(once);
+	}
+
+	//nested loops share the pool
+	std::atomic<int> total(0);
+	parallelFor(0, 64, [&](size_t)
+	{
+		parallelFor(0, 64, [&](size_t)
+		{
+			++total;
+		});
+	});
+	CHECK(total == 64 * 64);
+
+	//many small loops reuse the threads
+	for (int i = 0; i < 2000; ++i)
+	{
+		std::atomic<int> count(0);
+		parallelFor(0, 3, [&](size_t)
+		{
+			++count;
+		});
+		CHECK(count == 3);
+	}
+
+	//the first exception comes back to the caller, and the pool still works afterwards
+	bool thrown = false;
+	try
+	{
+		parallelFor(0, 1000, [&](size_t i)
+		{
+			if (i == 500)
+				throw std::runtime_error("500");
+		});
+	}
+	catch (std::runtime_error&)
+	{
+		thrown = true;
+	}
+	CHECK(thrown);
+
+	total = 0;
+	parallelFor(0, 100, [&](size_t)
+	{
+		++total;
+	});
+	CHECK(total == 100);
+}
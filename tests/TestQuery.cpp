@@ -0,0 +1,125 @@
+#include "AHDTest.h"
+#include "AHDQuery.h"
+#include <math.h>
+
+using namespace AHD;
+using namespace AHDTest;
+
+namespace
+{
+	bool bruteFilled(const BitGrid& grid, int x, int y, int z)
+	{
+		return x >= 0 && y >= 0 && z >= 0 && x < grid.getWidth() && y < grid.getHeight() && z < grid.getDepth() && grid.get(x, y, z);
+	}
+
+	bool bruteBox(const BitGrid& grid, const AABB& box)
+	{
+		if (!box.isValid())
+			return false;
+
+		const Vector3& a = box.getMin();
+		const Vector3& b = box.getMax();
+		for (int z = (int)floorf(a.z); z <= (int)floorf(b.z); ++z)
+		{
+			for (int y = (int)floorf(a.y); y <= (int)floorf(b.y); ++y)
+			{
+				for (int x = (int)floorf(a.x); x <= (int)floorf(b.x); ++x)
+				{
+					if (bruteFilled(grid, x, y, z))
+						return true;
+				}
+			}
+		}
+		return false;
+	}
+
+	bool getResult(const std::vector<BitGrid::Word>& results, size_t i)
+	{
+		return ((results[i / 64] >> (i % 64)) & 1) != 0;
+	}
+}
+
+TEST(BitGridAny)
+{
+	const int w = 150, h = 90, d = 70;
+	BitGrid grid(w, h, d);
+	for (int i = 0; i < 3000; ++i)
+		grid.set(randomInt(w), randomInt(h), randomInt(d), true);
+
+	for (int i = 0; i < 1000; ++i)
+	{
+		int box[6];
+		const int size[3] = { w, h, d };
+		for (int k = 0; k < 3; ++k)
+		{
+			box[k] = randomInt(size[k] + 20) - 10;
+			box[k + 3] = box[k] + randomInt(k == 0 ? 130 : 20);
+		}
+
+		bool expected = false;
+		for (int z = std::max(box[2], 0); z < std::min(box[5], d); ++z)
+		{
+			for (int y = std::max(box[1], 0); y < std::min(box[4], h); ++y)
+			{
+				for (int x = std::max(box[0], 0); x < std::min(box[3], w); ++x)
+					expected = expected || grid.get(x, y, z);
+			}
+		}
+		CHECK(grid.any(box[0], box[1], box[2], box[3], box[4], box[5]) == expected);
+	}
+}
+
+TEST(OccupancyQuery)
+{
+	const int w = 150, h = 90, d = 70;
+	BitGrid grid(w, h, d);
+	for (int i = 0; i < 3000; ++i)
+		grid.set(randomInt(w), randomInt(h), randomInt(d), true);
+
+	OccupancyQuery query;
+	query.build(grid);
+
+	const size_t count = 20001;
+	std::vector<Vector3> points(count);
+	std::vector<AABB> boxes(count);
+	for (size_t i = 0; i < count; ++i)
+	{
+		points[i] = Vector3(randomFloat() * (w + 20) - 10, randomFloat() * (h + 20) - 10, randomFloat() * (d + 20) - 10);
+		if (i % 13 == 0)
+			boxes[i].setNull();
+		else
+			boxes[i].setExtents(points[i], Vector3(points[i].x + randomFloat() * 6, points[i].y + randomFloat() * 6, points[i].z + randomFloat() * 6));
+	}
+	//far outside of the int range, and nan
+	points[1] = Vector3(-1e20f, 0.5f, 0.5f);
+	points[2] = Vector3(1e20f, -3e9f, 0.5f);
+	points[3] = Vector3(sqrtf(-1.0f), 0.5f, 0.5f);
+
+	std::vector<BitGrid::Word> results((count + 63) / 64);
+	std::vector<BitGrid::Word> boxResults((count + 63) / 64);
+	query.queryPoints(points.data(), count, results.data());
+	query.queryBoxes(boxes.data(), count, boxResults.data());
+	for (size_t i = 0; i < count; ++i)
+	{
+		const Vector3& p = points[i];
+		bool expected = p.x == p.x && fabsf(p.x) < 1e9f && fabsf(p.y) < 1e9f && fabsf(p.z) < 1e9f &&
+						bruteFilled(grid, (int)floorf(p.x), (int)floorf(p.y), (int)floorf(p.z));
+		CHECK(getResult(results, i) == expected);
+		CHECK(getResult(boxResults, i) == bruteBox(grid, boxes[i]));
+	}
+
+	//edits through setVoxel keep the levels up to date
+	for (int i = 0; i < 5000; ++i)
+	{
+		int x = randomInt(w), y = randomInt(h), z = randomInt(d);
+		bool filled = randomInt(3) == 0;
+		grid.set(x, y, z, filled);
+		query.setVoxel(x, y, z, filled);
+	}
+	query.queryPoints(points.data(), count, results.data());
+	for (size_t i = 4; i < count; ++i)
+	{
+		const Vector3& p = points[i];
+		CHECK(getResult(results, i) == bruteFilled(grid, (int)floorf(p.x), (int)floorf(p.y), (int)floorf(p.z)));
+	}
+}
@@ -0,0 +1,136 @@
+#include "AHDTest.h"
+#include "AHDRayCast.h"
+#include <math.h>
+#include <limits>
+
+using namespace AHD;
+using namespace AHDTest;
+
+namespace
+{
+	//the entry distance of the ray into the closest filled voxel, by intersecting the box of every voxel
+	bool bruteCast(const BitGrid& grid, const Ray& ray, float& distance)
+	{
+		const float* o = &ray.origin.x;
+		const float* d = &ray.direction.x;
+		double best = std::numeric_limits<double>::infinity();
+		for (int z = 0; z < grid.getDepth(); ++z)
+		{
+			for (int y = 0; y < grid.getHeight(); ++y)
+			{
+				for (int x = 0; x < grid.getWidth(); ++x)
+				{
+					if (!grid.get(x, y, z))
+						continue;
+
+					const int v[3] = { x, y, z };
+					double t0 = 0, t1 = ray.maxDistance;
+					for (int k = 0; k < 3 && t0 <= t1; ++k)
+					{
+						if (d[k] == 0)
+						{
+							if (o[k] < v[k] || o[k] > v[k] + 1)
+								t1 = -1;
+							continue;
+						}
+						double a = (v[k] - o[k]) / (double)d[k];
+						double b = (v[k] + 1 - o[k]) / (double)d[k];
+						t0 = std::max(t0, std::min(a, b));
+						t1 = std::min(t1, std::max(a, b));
+					}
+					if (t0 <= t1)
+						best = std::min(best, t0);
+				}
+			}
+		}
+
+		distance = (float)best;
+		return best != std::numeric_limits<double>::infinity();
+	}
+
+	void checkCast(const BitGrid& grid, const RayCaster& caster, const Ray& ray)
+	{
+		RayHit hit;
+		bool found = caster.cast(ray, hit);
+		float distance;
+		bool expected = bruteCast(grid, ray, distance);
+		//grazing a voxel at the max distance can go either way
+		if (found != expected)
+		{
+			float far = found ? hit.distance : distance;
+			CHECK(fabs(far - ray.maxDistance) < 1e-3f);
+			return;
+		}
+		if (!found)
+			return;
+
+		CHECK(fabs(hit.distance - distance) < 1e-3f);
+		CHECK(grid.get(hit.voxel[0], hit.voxel[1], hit.voxel[2]));
+		//the hit point is on the face the ray entered through
+		if (hit.face >= 0)
+		{
+			const int axis = hit.face % 3;
+			float p = (&ray.origin.x)[axis] + (&ray.direction.x)[axis] * hit.distance;
+			CHECK(fabs(p - (hit.voxel[axis] + (hit.face < 3 ? 1 : 0))) < 1e-3f);
+		}
+	}
+}
+
+TEST(RayCast)
+{
+	const int w = 37, h = 29, d = 45;
+	BitGrid grid(w, h, d);
+	for (int i = 0; i < 1500; ++i)
+		grid.set(randomInt(w), randomInt(h), randomInt(d), true);
+
+	RayCaster caster;
+	caster.build(grid);
+
+	std::vector<Ray> rays;
+	for (int i = 0; i < 400; ++i)
+	{
+		Ray ray;
+		ray.origin = Vector3(randomFloat() * 80 - 20, randomFloat() * 70 - 20, randomFloat() * 90 - 20);
+		Vector3 target(randomFloat() * w, randomFloat() * h, randomFloat() * d);
+		float scale = 1.0f / (1 + randomFloat());
+		ray.direction = Vector3((target.x - ray.origin.x) * scale, (target.y - ray.origin.y) * scale, (target.z - ray.origin.z) * scale);
+		//axis aligned rays and short ones
+		if (i % 7 == 0)
+			ray.direction.y = 0;
+		if (i % 11 == 0)
+		{
+			ray.direction.x = 0;
+			ray.origin.x = randomInt(w) + 0.5f;
+		}
+		ray.maxDistance = i % 5 == 0 ? 1.0f : 100.0f;
+		rays.push_back(ray);
+	}
+
+	std::vector<RayHit> hits(rays.size());
+	caster.cast(rays.data(), rays.size(), hits.data());
+	for (size_t i = 0; i < rays.size(); ++i)
+	{
+		checkCast(grid, caster, rays[i]);
+
+		//the batch gives the same answers as single rays
+		RayHit hit;
+		bool found = caster.cast(rays[i], hit);
+		CHECK(found == hits[i].hit);
+		if (found && hits[i].hit)
+		{
+			CHECK(hit.voxel[0] == hits[i].voxel[0] && hit.voxel[1] == hits[i].voxel[1] && hit.voxel[2] == hits[i].voxel[2]);
+			CHECK(hit.face == hits[i].face);
+		}
+	}
+
+	//edits through setVoxel
+	for (int i = 0; i < 200; ++i)
+	{
+		int x = randomInt(w), y = randomInt(h), z = randomInt(d);
+		bool filled = randomInt(2) != 0;
+		grid.set(x, y, z, filled);
+		caster.setVoxel(x, y, z, filled);
+	}
+	for (auto& ray : rays)
+		checkCast(grid, caster, ray);
+}
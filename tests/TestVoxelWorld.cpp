@@ -0,0 +1,134 @@
+#include "AHDTest.h"
+#include "AHDVoxelWorld.h"
+
+using namespace AHD;
+using namespace AHDTest;
+
+namespace
+{
+	//every chunk of world against a serial mesher with the exterior of the whole grid found again
+	void checkChunks(const VoxelWorld& world, const Mesher& settings)
+	{
+		BitGrid grid, exterior;
+		grid.fromVoxels(world.getVoxels());
+		grid.getExterior(exterior);
+
+		Mesher mesher;
+		mesher.setMode(settings.getMode());
+		mesher.setAmbientOcclusion(settings.getAmbientOcclusion());
+		mesher.setParallel(false);
+		if (world.getExteriorOnly())
+			mesher.setExterior(&exterior);
+
+		Palette palette;
+		const int size = VoxelWorld::CHUNK_SIZE;
+		for (int c = 0; c < world.getChunkCount(); ++c)
+		{
+			CHECK(!world.isDirty(c));
+			int o[3];
+			world.getChunkOrigin(c, o);
+			mesher.setRegion(o[0], o[1], o[2], o[0] + size, o[1] + size, o[2] + size);
+			mesher.meshPacked(world.getVoxels(), palette);
+
+			const std::vector<PackedVertex>& a = world.getVertices(c);
+			const std::vector<PackedVertex>& b = mesher.getPackedVertices();
+			CHECK(a.size() == b.size());
+			if (a.size() != b.size())
+				continue;
+
+			bool same = true;
+			for (size_t i = 0; i < a.size() && same; ++i)
+			{
+				same = a[i].x == b[i].x && a[i].y == b[i].y && a[i].z == b[i].z && a[i].normal == b[i].normal &&
+					   a[i].ao == b[i].ao && world.getPalette().getColor(a[i].color) == palette.getColor(b[i].color);
+			}
+			CHECK(same);
+			CHECK(world.getShortIndexes(c) == mesher.getShortIndexes());
+			CHECK(world.getIndexes(c) == mesher.getIndexes());
+		}
+	}
+}
+
+TEST(VoxelWorld)
+{
+	const int w = 70, h = 50, d = 45;
+	VoxelData data;
+	data.width = w;
+	data.height = h;
+	data.depth = d;
+	data.datas.assign((size_t)w * h * d * sizeof(int), 0);
+	int* voxels = (int*)data.datas.data();
+
+	//hollow boxes in noise, the edits below open and seal them
+	const int CENTERS[4] = { 10, 25, 40, 55 };
+	for (int z = 0; z < d; ++z)
+	{
+		for (int y = 0; y < h; ++y)
+		{
+			for (int x = 0; x < w; ++x)
+			{
+				bool shell = false;
+				for (int b = 0; b < 4; ++b)
+				{
+					int m = std::max(abs(x - CENTERS[b]), std::max(abs(y - 20), abs(z - 20)));
+					shell = shell || m == 6 || m == 3;
+				}
+				voxels[(z * h + y) * w + x] = shell || randomInt(13) == 0 ? 1 + randomInt(40) : 0;
+			}
+		}
+	}
+
+	for (int exteriorOnly = 0; exteriorOnly < 2; ++exteriorOnly)
+	{
+		VoxelWorld world;
+		world.fromVoxels(data);
+		world.setExteriorOnly(exteriorOnly != 0);
+
+		Mesher settings;
+		settings.setAmbientOcclusion(true);
+		CHECK(world.update(settings) == world.getChunkCount());
+		checkChunks(world, settings);
+
+		//a hole in the outer shell of a box opens the inside, filling it again seals it
+		const int hole = CENTERS[1] - 6;
+		const int color = world.get(hole, 20, 20);
+		for (int i = 0; i < 2; ++i)
+		{
+			world.set(hole, 20, 20, i == 0 ? 0 : 1);
+			world.update(settings);
+			checkChunks(world, settings);
+		}
+		world.set(hole, 20, 20, color);
+		world.update(settings);
+		checkChunks(world, settings);
+
+		for (int round = 0; round < 12; ++round)
+		{
+			const int edits = round % 3 == 0 ? 1 : randomInt(20);
+			for (int i = 0; i < edits; ++i)
+			{
+				int x, y, z;
+				if (round % 2 == 0)
+				{
+					x = randomInt(w);
+					y = randomInt(h);
+					z = randomInt(d);
+				}
+				else
+				{
+					x = CENTERS[randomInt(4)] + randomInt(13) - 6;
+					y = 20 + randomInt(13) - 6;
+					z = 20 + randomInt(13) - 6;
+				}
+				world.set(x, y, z, randomInt(2) == 0 ? 0 : 1 + randomInt(60));
+			}
+			world.update(settings);
+			checkChunks(world, settings);
+		}
+
+		//nothing changed, nothing to do
+		CHECK(world.update(settings) == 0);
+		world.set(5, 5, 5, world.get(5, 5, 5));
+		CHECK(world.update(settings) == 0);
+	}
+}
@@ -0,0 +1,79 @@
+#include "AHDTest.h"
+#include <string.h>
+#include <exception>
+#include <vector>
+
+namespace
+{
+	struct Entry
+	{
+		const char* name;
+		AHDTest::TestFunc func;
+	};
+
+	//function local, so registration does not depend on the order of static initialization
+	std::vector<Entry>& getTests()
+	{
+		static std::vector<Entry> tests;
+		return tests;
+	}
+
+	int failures = 0;
+	unsigned int seed = 1;
+}
+
+AHDTest::TestCase::TestCase(const char* name, TestFunc func)
+{
+	Entry entry = { name, func };
+	getTests().push_back(entry);
+}
+
+void AHDTest::fail(const char* file, int line, const char* expression)
+{
+	//the first few are enough to see what went wrong
+	if (++failures <= 20)
+		printf("%s(%d): CHECK(%s) failed\n", file, line, expression);
+}
+
+float AHDTest::randomFloat()
+{
+	seed = seed * 1664525u + 1013904223u;
+	return (seed >> 8) * (1.0f / 16777216.0f);
+}
+
+int AHDTest::randomInt(int n)
+{
+	return (int)(randomFloat() * n);
+}
+
+//runs the test named by the argument, or all of them
+int main(int argc, char** argv)
+{
+	int run = 0;
+	for (auto& test : getTests())
+	{
+		if (argc > 1 && strcmp(argv[1], test.name) != 0)
+			continue;
+
+		++run;
+		int before = failures;
+		seed = 1;
+		try
+		{
+			test.func();
+		}
+		catch (std::exception& e)
+		{
+			printf("%s: exception %s\n", test.name, e.what());
+			++failures;
+		}
+		printf("%s: %s\n", test.name, failures == before ? "passed" : "FAILED");
+	}
+
+	if (run == 0)
+	{
+		printf("no test named %s\n", argc > 1 ? argv[1] : "");
+		return 1;
+	}
+	return failures == 0 ? 0 : 1;
+}